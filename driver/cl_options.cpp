@@ -667,7 +667,16 @@ cl::opt<CoverageIncrement> coverageIncrement(
                clEnumValN(CoverageIncrement::nonatomic, "non-atomic",
                           "Non-atomic increment (not thread safe)"),
                clEnumValN(CoverageIncrement::boolean, "boolean",
-                          "Don't read, just set counter to 1")));
+                          "Don't read, just set counter to 1"),
+               clEnumValN(CoverageIncrement::sharded, "sharded",
+                          "Non-atomic increment of thread-local counters, "
+                          "added to the module's counters at thread exit")));
+
+cl::opt<bool> coverageEdges(
+    "cov-edges", cl::ZeroOrMore,
+    cl::desc("Count the executions of a minimal set of control flow edges "
+             "instead of each line; the line counts are computed when a "
+             "thread exits (ignored with -cov-increment=boolean)"));
 
 // Compilation time tracing options
 cl::opt<bool> fTimeTrace(
@@ -694,6 +703,11 @@ cl::opt<bool> ltoFatObjects(
     "ffat-lto-objects", cl::ZeroOrMore,
     cl::desc("Include both IR and object code in object file output; only "
              "effective when compiling with -flto."));
+cl::opt<bool> fWholeProgramVtables(
+    "fwhole-program-vtables", cl::ZeroOrMore,
+    cl::desc("Enable whole-program devirtualization of virtual calls through "
+             "D classes with hidden visibility (-fvisibility=hidden); requires "
+             "-flto and all subclasses to be part of the LTO unit"));
 
 cl::opt<std::string>
     saveOptimizationRecord("fsave-optimization-record",
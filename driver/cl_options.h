@@ -115,9 +115,11 @@ enum class CoverageIncrement
     _default,
     atomic,
     nonatomic,
-    boolean
+    boolean,
+    sharded
 };
 extern cl::opt<CoverageIncrement> coverageIncrement;
+extern cl::opt<bool> coverageEdges;
 
 // Compilation time tracing options
 extern cl::opt<bool> fTimeTrace;
@@ -134,6 +136,7 @@ extern cl::opt<LTOKind> ltoMode;
 inline bool isUsingLTO() { return ltoMode != LTO_None; }
 inline bool isUsingThinLTO() { return ltoMode == LTO_Thin; }
 extern cl::opt<bool> ltoFatObjects;
+extern cl::opt<bool> fWholeProgramVtables;
 
 extern cl::opt<std::string> saveOptimizationRecord;
 
@@ -84,6 +84,12 @@ static cl::opt<bool> dmdFunctionTrace(
     "fdmd-trace-functions", cl::ZeroOrMore,
     cl::desc("DMD-style runtime performance profiling of generated code"));
 
+cl::opt<bool> traceFunctions(
+    "ftrace-functions", cl::ZeroOrMore,
+    cl::desc("Record timestamped function entries and exits into per-thread "
+             "buffers, written to trace.ldctrace (overridden by "
+             "LDC_TRACE_FILE env var)"));
+
 cl::opt<bool> fXRayInstrument(
     "fxray-instrument", cl::ZeroOrMore,
     cl::desc("Generate XRay instrumentation sleds on function entry and exit"));
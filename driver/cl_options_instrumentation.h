@@ -26,6 +26,8 @@ namespace cl = llvm::cl;
 
 extern cl::opt<bool> instrumentFunctions;
 
+extern cl::opt<bool> traceFunctions;
+
 extern cl::opt<bool> fXRayInstrument;
 llvm::StringRef getXRayInstructionThresholdString();
 
@@ -555,6 +555,10 @@ void parseCommandLine(Strings &sourceFiles) {
     error(Loc(), "-soname can be used only when building a shared library");
   }
 
+  if (opts::fWholeProgramVtables && !opts::isUsingLTO()) {
+    error(Loc(), "-fwhole-program-vtables can only be used with -flto");
+  }
+
   global.params.dihdr.fullOutput = opts::hdrKeepAllBodies;
   global.params.disableRedZone = opts::disableRedZone();
 
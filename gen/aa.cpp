@@ -34,6 +34,28 @@ static LLConstant *to_keyti(const Loc &loc, DValue *aa) {
   return DtoTypeInfoOf(loc, aatype->index);
 }
 
+// returns the name of the druntime function `name` specialized for the key type
+// of `aa` (`char[]`, 32/64-bit integers and pointers), or `name` itself
+static std::string getKeySpecializedName(DValue *aa, const char *name) {
+  auto aatype = static_cast<TypeAArray *>(aa->type->toBasetype());
+  Type *key = aatype->index->toBasetype();
+
+  // The runtime checks whether the AA uses the hash function of these types,
+  // e.g. not for enum keys, and otherwise falls back to the generic version.
+  const char *suffix = nullptr;
+  if (key->ty == TY::Tarray && key->nextOf()->toBasetype()->ty == TY::Tchar) {
+    suffix = "_str";
+  } else if (key->isintegral() && size(key) == 4) {
+    suffix = "_u32";
+  } else if (key->isintegral() && size(key) == 8) {
+    suffix = "_u64";
+  } else if (key->ty == TY::Tpointer) {
+    suffix = "_ptr";
+  }
+
+  return suffix ? std::string(name) + suffix : name;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 DLValue *DtoAAIndex(const Loc &loc, Type *type, DValue *aa, DValue *key,
@@ -46,8 +68,9 @@ DLValue *DtoAAIndex(const Loc &loc, Type *type, DValue *aa, DValue *key,
   // extern(C) void* _aaInX(AA aa*, TypeInfo keyti, void* pkey)
 
   // first get the runtime function
-  llvm::Function *func =
-      getRuntimeFunction(loc, gIR->module, lvalue ? "_aaGetY" : "_aaInX");
+  llvm::Function *func = getRuntimeFunction(
+      loc, gIR->module,
+      getKeySpecializedName(aa, lvalue ? "_aaGetY" : "_aaInX").c_str());
 
   // aa param
   LLValue *aaval = lvalue ? DtoLVal(aa) : DtoRVal(aa);
@@ -103,7 +126,8 @@ DValue *DtoAAIn(const Loc &loc, Type *type, DValue *aa, DValue *key) {
   // extern(C) void* _aaInX(AA aa*, TypeInfo keyti, void* pkey)
 
   // first get the runtime function
-  llvm::Function *func = getRuntimeFunction(loc, gIR->module, "_aaInX");
+  llvm::Function *func = getRuntimeFunction(
+      loc, gIR->module, getKeySpecializedName(aa, "_aaInX").c_str());
 
   IF_LOG Logger::cout() << "_aaIn = " << *func << '\n';
 
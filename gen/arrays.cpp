@@ -17,18 +17,22 @@
 #include "dmd/init.h"
 #include "dmd/module.h"
 #include "dmd/mtype.h"
+#include "gen/binops.h"
 #include "gen/dvalue.h"
 #include "gen/funcgenstate.h"
 #include "gen/irstate.h"
 #include "gen/llvm.h"
 #include "gen/llvmhelpers.h"
 #include "gen/logger.h"
+#include "gen/passes/metadata.h"
 #include "gen/runtime.h"
+#include "gen/structs.h"
 #include "gen/tollvm.h"
 #include "ir/irfunction.h"
 #include "ir/irmodule.h"
 #include <llvm/Analysis/ConstantFolding.h>
 #include <llvm/IR/Constant.h>
+#include <llvm/IR/MDBuilder.h>
 
 using namespace dmd;
 
@@ -722,11 +726,20 @@ bool validCompareWithMemcmpType(Type *t) {
     return validCompareWithMemcmpType(elemType);
   }
 
-  case TY::Tstruct:
-    // TODO: Implement when structs can be compared with memcmp. Remember that
-    // structs can have a user-defined opEquals, alignment padding bytes (in
-    // arrays), and padding bytes.
-    return false;
+  case TY::Tstruct: {
+    // Structs without (generated) opEquals are compared bitwise, incl. their
+    // padding, both by `DtoStructEquals` and by `TypeInfo_Struct.equals`.
+    // Unlike the frontend's `needOpEquals`, unions are only accepted if all
+    // their fields can be compared with memcmp.
+    auto sd = static_cast<TypeStruct *>(t)->sym;
+    if (sd->hasIdentityEquals())
+      return false;
+    for (auto vd : sd->fields) {
+      if (!validCompareWithMemcmpType(vd->type->toBasetype()))
+        return false;
+    }
+    return true;
+  }
 
   case TY::Tvoid:
   case TY::Tint8:
@@ -754,6 +767,98 @@ bool validCompareWithMemcmpType(Type *t) {
   }
 }
 
+/// When `true` is returned, elements of type `t` can be compared by
+/// `DtoElementEquals`, without TypeInfo and runtime calls. Like the
+/// frontend-generated `__xopEquals`, structs with floating-point fields are
+/// compared field by field.
+bool validInlineEqualsType(Type *t) {
+  if (validCompareWithMemcmpType(t))
+    return true;
+
+  switch (t->ty) {
+  case TY::Tfloat32:
+  case TY::Tfloat64:
+  case TY::Tfloat80:
+  case TY::Timaginary32:
+  case TY::Timaginary64:
+  case TY::Timaginary80:
+  case TY::Tcomplex32:
+  case TY::Tcomplex64:
+  case TY::Tcomplex80:
+    return true;
+
+  case TY::Tsarray: {
+    // unrolled in DtoElementEquals
+    auto tsa = static_cast<TypeSArray *>(t);
+    return tsa->dim->toUInteger() <= 16 &&
+           validInlineEqualsType(tsa->nextOf()->toBasetype());
+  }
+
+  case TY::Tstruct: {
+    auto sd = static_cast<TypeStruct *>(t)->sym;
+    if (sd->hasIdentityEquals() || sd->isUnionDeclaration())
+      return false;
+    for (auto vd : sd->fields) {
+      if (vd->overlapped() || vd->isBitFieldDeclaration() ||
+          !validInlineEqualsType(vd->type->toBasetype())) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  default:
+    return false;
+  }
+}
+
+/// Returns an i1 which is true if the elements of type `t` at `lhs` and `rhs`
+/// are equal. See `validInlineEqualsType`.
+LLValue *DtoElementEquals(const Loc &loc, Type *t, LLValue *lhs,
+                          LLValue *rhs) {
+  t = t->toBasetype();
+
+  if (t->isfloating()) {
+    return DtoBinNumericEquals(loc, new DLValue(t, lhs), new DLValue(t, rhs),
+                               EXP::equal);
+  }
+
+  if (t->ty == TY::Tsarray) {
+    Type *elemType = t->nextOf()->toBasetype();
+    LLType *elemLLType = DtoMemType(elemType);
+    LLValue *res = DtoConstBool(true);
+    const auto dim = static_cast<TypeSArray *>(t)->dim->toUInteger();
+    for (unsigned i = 0; i < dim; ++i) {
+      LLValue *eq = DtoElementEquals(loc, elemType,
+                                     DtoGEP1(elemLLType, lhs, i),
+                                     DtoGEP1(elemLLType, rhs, i));
+      res = gIR->ir->CreateAnd(res, eq);
+    }
+    return res;
+  }
+
+  if (t->ty == TY::Tstruct) {
+    if (validCompareWithMemcmpType(t)) {
+      return DtoStructEquals(EXP::equal, new DLValue(t, lhs),
+                             new DLValue(t, rhs));
+    }
+    // field by field, like `lhs.tupleof == rhs.tupleof`
+    auto sd = static_cast<TypeStruct *>(t)->sym;
+    LLValue *res = DtoConstBool(true);
+    for (auto vd : sd->fields) {
+      LLValue *lfield = DtoLVal(DtoIndexAggregate(lhs, sd, vd));
+      LLValue *rfield = DtoLVal(DtoIndexAggregate(rhs, sd, vd));
+      res = gIR->ir->CreateAnd(
+          res, DtoElementEquals(loc, vd->type, lfield, rfield));
+    }
+    return res;
+  }
+
+  // integral, pointer
+  LLType *type = DtoMemType(t);
+  return gIR->ir->CreateICmpEQ(DtoLoad(type, lhs), DtoLoad(type, rhs));
+}
+
 /// When `true` is returned, `l` and `r` can be compared using `memcmp`.
 ///
 /// This function may return `false` even though `memcmp` would be valid.
@@ -840,6 +945,90 @@ LLValue *DtoArrayEqCmp_memcmp(const Loc &loc, DValue *l, DValue *r,
 
   return phi;
 }
+
+/// When `true` is returned, `l` and `r` can be compared by
+/// `DtoArrayEquals_inline`.
+bool validInlineEquals(DValue *l, DValue *r) {
+  auto *lElemType = l->type->toBasetype()->nextOf()->toBasetype();
+  auto *rElemType = r->type->toBasetype()->nextOf()->toBasetype();
+  return equivalent(lElemType, rElemType) && validInlineEqualsType(lElemType);
+}
+
+/// Compare `l` and `r` element by element in inline code, returning an i1
+/// which is true if they are equal. See `validInlineEqualsType`.
+///
+/// The elements are compared in blocks without early exit, which LLVM can
+/// vectorize; unequal arrays exit after the first block with a difference.
+LLValue *DtoArrayEquals_inline(const Loc &loc, DValue *l, DValue *r,
+                               IRState &irs) {
+  IF_LOG Logger::println("Comparing arrays inline");
+  LOG_SCOPE;
+
+  constexpr unsigned blockLength = 64;
+
+  Type *elemType = l->type->toBasetype()->nextOf()->toBasetype();
+  LLType *elemLLType = DtoMemType(elemType);
+  LLValue *lptr = DtoArrayPtr(l);
+  LLValue *rptr = DtoArrayPtr(r);
+  LLValue *length = DtoArrayLen(l);
+  LLValue *zero = DtoConstSize_t(0);
+
+  llvm::BasicBlock *blockBB = irs.insertBB("arrayeq.block");
+  llvm::BasicBlock *elemBB = irs.insertBBAfter(blockBB, "arrayeq.elem");
+  llvm::BasicBlock *nextBB = irs.insertBBAfter(elemBB, "arrayeq.next");
+  llvm::BasicBlock *endBB = irs.insertBBAfter(nextBB, "arrayeq.end");
+
+  auto result =
+      llvm::PHINode::Create(irs.ir->getInt1Ty(), 4, "arrayeq", endBB);
+
+  // Unequal lengths or empty arrays
+  llvm::BasicBlock *nonEmptyBB =
+      irs.insertBBAfter(irs.scopebb(), "arrayeq.nonempty");
+  LLValue *lengthsEqual = irs.ir->CreateICmpEQ(length, DtoArrayLen(r));
+  result->addIncoming(irs.ir->getFalse(), irs.scopebb());
+  irs.ir->CreateCondBr(lengthsEqual, nonEmptyBB, endBB);
+  irs.ir->SetInsertPoint(nonEmptyBB);
+  result->addIncoming(irs.ir->getTrue(), nonEmptyBB);
+  irs.ir->CreateCondBr(irs.ir->CreateICmpEQ(length, zero), endBB, blockBB);
+
+  // for (start = 0; ; start = blockEnd)
+  irs.ir->SetInsertPoint(blockBB);
+  llvm::PHINode *start = irs.ir->CreatePHI(DtoSize_t(), 2, "start");
+  start->addIncoming(zero, nonEmptyBB);
+  LLValue *blockEnd = irs.ir->CreateAdd(
+      start, irs.ir->CreateBinaryIntrinsic(
+                 llvm::Intrinsic::umin, irs.ir->CreateSub(length, start),
+                 DtoConstSize_t(blockLength)),
+      "blockEnd");
+  irs.ir->CreateBr(elemBB);
+
+  //   for (i = start; i < blockEnd; ++i) equal &= l[i] == r[i]
+  irs.ir->SetInsertPoint(elemBB);
+  llvm::PHINode *index = irs.ir->CreatePHI(DtoSize_t(), 2, "i");
+  llvm::PHINode *equal = irs.ir->CreatePHI(irs.ir->getInt1Ty(), 2, "equal");
+  index->addIncoming(start, blockBB);
+  equal->addIncoming(irs.ir->getTrue(), blockBB);
+  LLValue *elemEqual =
+      DtoElementEquals(loc, elemType, DtoGEP1(elemLLType, lptr, index),
+                       DtoGEP1(elemLLType, rptr, index));
+  LLValue *newEqual = irs.ir->CreateAnd(equal, elemEqual);
+  LLValue *newIndex = irs.ir->CreateNUWAdd(index, DtoConstSize_t(1));
+  index->addIncoming(newIndex, irs.scopebb());
+  equal->addIncoming(newEqual, irs.scopebb());
+  irs.ir->CreateCondBr(irs.ir->CreateICmpEQ(newIndex, blockEnd), nextBB,
+                       elemBB);
+
+  //   if (!equal || blockEnd == length) break;
+  irs.ir->SetInsertPoint(nextBB);
+  start->addIncoming(blockEnd, nextBB);
+  result->addIncoming(newEqual, nextBB);
+  irs.ir->CreateCondBr(
+      irs.ir->CreateAnd(newEqual, irs.ir->CreateICmpNE(blockEnd, length)),
+      blockBB, endBB);
+
+  irs.ir->SetInsertPoint(endBB);
+  return result;
+}
 } // end anonymous namespace
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -857,6 +1046,12 @@ LLValue *DtoArrayEquals(const Loc &loc, EXP op, DValue *l, DValue *r) {
     const auto predicate = eqTokToICmpPred(op);
     const auto memcmp_result = DtoArrayEqCmp_memcmp(loc, l, r, *gIR);
     res = gIR->ir->CreateICmp(predicate, memcmp_result, DtoConstInt(0));
+  } else if (validInlineEquals(l, r)) {
+    // Compare the elements inline instead of with TypeInfo in `_adEq2`, e.g.
+    // floating-point arrays and arrays of structs with floating-point fields.
+    res = DtoArrayEquals_inline(loc, l, r, *gIR);
+    if (op == EXP::notEqual)
+      res = gIR->ir->CreateNot(res);
   } else {
     res = DtoArrayEqCmp_impl(loc, "_adEq2", l, r, true);
     const auto predicate = eqTokToICmpPred(op, /* invert = */ true);
@@ -1051,7 +1246,7 @@ void DtoIndexBoundsCheck(const Loc &loc, DValue *arr, DValue *index) {
 
   llvm::BasicBlock *okbb = gIR->insertBB("bounds.ok");
   llvm::BasicBlock *failbb = gIR->insertBBAfter(okbb, "bounds.fail");
-  gIR->ir->CreateCondBr(cond, okbb, failbb);
+  emitBoundsCheckBranch(gIR, cond, okbb, failbb);
 
   // set up failbb to call the array bounds error runtime function
   gIR->ir->SetInsertPoint(failbb);
@@ -1061,6 +1256,15 @@ void DtoIndexBoundsCheck(const Loc &loc, DValue *arr, DValue *index) {
   gIR->ir->SetInsertPoint(okbb);
 }
 
+void emitBoundsCheckBranch(IRState *irs, LLValue *okCond,
+                           llvm::BasicBlock *okbb, llvm::BasicBlock *failbb) {
+  // same weights as for `__builtin_expect`
+  llvm::MDBuilder mdBuilder(irs->context());
+  llvm::BranchInst *br = irs->ir->CreateCondBr(
+      okCond, okbb, failbb, mdBuilder.createBranchWeights(2000, 1));
+  br->setMetadata(BOUNDS_CHECK_MD, llvm::MDNode::get(irs->context(), {}));
+}
+
 static void emitRangeErrorImpl(IRState *irs, const Loc &loc,
                                const char *cAssertMsg, const char *dFnName,
                                llvm::ArrayRef<LLValue *> extraArgs) {
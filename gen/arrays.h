@@ -79,6 +79,12 @@ DValue *DtoCastArray(const Loc &loc, DValue *val, Type *to);
 // generates an array bounds check
 void DtoIndexBoundsCheck(const Loc &loc, DValue *arr, DValue *index);
 
+/// Emits the conditional branch of a bounds check to `okbb` or `failbb`,
+/// tagged for the bounds check elimination pass and weighted for the
+/// likely in-bounds case.
+void emitBoundsCheckBranch(IRState *irs, LLValue *okCond,
+                           llvm::BasicBlock *okbb, llvm::BasicBlock *failbb);
+
 /// Inserts a call to the druntime function that throws the range error, with
 /// the given location.
 void emitRangeError(IRState *irs, const Loc &loc);
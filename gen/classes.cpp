@@ -17,6 +17,7 @@
 #include "dmd/init.h"
 #include "dmd/mtype.h"
 #include "dmd/target.h"
+#include "driver/cl_options.h"
 #include "gen/arrays.h"
 #include "gen/dvalue.h"
 #include "gen/functions.h"
@@ -24,6 +25,7 @@
 #include "gen/llvm.h"
 #include "gen/llvmhelpers.h"
 #include "gen/logger.h"
+#include "gen/mangling.h"
 #include "gen/nested.h"
 #include "gen/optimizer.h"
 #include "gen/runtime.h"
@@ -154,21 +156,11 @@ void DtoInitClass(TypeClass *tc, LLValue *dst) {
     DtoStore(val, tmp);
   }
 
-  // Copy the rest from the static initializer, if any.
+  // Initialize the rest from the static initializer, if any.
   unsigned const firstDataIdx = isCPPclass ? 1 : 2;
-  uint64_t const dataBytes =
-      tc->sym->structsize - target.ptrsize * firstDataIdx;
-  if (dataBytes == 0) {
-    return;
-  }
-
-  LLValue *dstarr = DtoGEP(st, dst, 0, firstDataIdx);
-
-  // init symbols might not have valid types
-  LLValue *initsym = irClass->getInitSymbol();
-  LLValue *srcarr = DtoGEP(st, initsym, 0, firstDataIdx);
-
-  DtoMemCpy(dstarr, srcarr, DtoConstSize_t(dataBytes));
+  // Class instances are at least pointer-aligned (vtbl).
+  DtoInitAggregate(tc->sym, dst, target.ptrsize,
+                   target.ptrsize * firstDataIdx);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -347,6 +339,115 @@ static void resolveObjectAndClassInfoClasses() {
   DtoResolveClass(Type::typeinfoclass);
 }
 
+// Returns the inline cache of the dynamic casts to the class or interface of
+// `cinfo`: the ClassInfos of the last objects the cast succeeded and failed
+// for. Shared by all casts to that type in the binary.
+static llvm::GlobalVariable *getDynamicCastCache(llvm::GlobalVariable *cinfo) {
+  const auto name = ("ldc.dyncast_cache." + cinfo->getName()).str();
+  auto cache = gIR->module.getGlobalVariable(name, true);
+  if (!cache) {
+    auto type = llvm::ArrayType::get(getOpaquePtrType(), 2);
+    cache = new llvm::GlobalVariable(gIR->module, type, false,
+                                     LLGlobalValue::LinkOnceODRLinkage,
+                                     llvm::ConstantAggregateZero::get(type),
+                                     name);
+    cache->setVisibility(LLGlobalValue::HiddenVisibility);
+    const auto &triple = *global.params.targetTriple;
+    setLinkage({LLGlobalValue::LinkOnceODRLinkage,
+                needsCOMDAT() || triple.isOSBinFormatELF()},
+               cache);
+  }
+  return cache;
+}
+
+// Emits `_d_dynamic_cast(obj, cinfo)` with inline fast paths:
+//   if (!obj) return null;
+//   if (final class && obj.__vptr is cd.__vtbl) return obj;
+//   auto oc = obj.__vptr[0]; // typeid(obj)
+//   if (oc is cache.succeeded) return obj; // class targets only
+//   if (oc is cache.failed) return null;
+//   auto r = _d_dynamic_cast(obj, cinfo);
+//   (r ? cache.succeeded : cache.failed) = oc;
+//   return r;
+// A result depends only on the dynamic ClassInfo, so the cache entries are
+// valid for all objects of that class. Casts to interfaces may adjust the
+// pointer, so only their failures are cached.
+static LLValue *emitInlineDynamicCast(const Loc &loc, LLValue *obj,
+                                      ClassDeclaration *cd,
+                                      llvm::GlobalVariable *cinfo) {
+  IF_LOG Logger::println("inline dynamic cast to %s", cd->toChars());
+  LOG_SCOPE;
+
+  const auto ptrType = getOpaquePtrType();
+  const auto nullPtr = getNullPtr();
+  const bool isInterface = cd->isInterfaceDeclaration() != nullptr;
+  const bool isFinal = !isInterface && (cd->storage_class & STCfinal);
+
+  auto cache = getDynamicCastCache(cinfo);
+  auto cacheType = cache->getValueType();
+  auto succeededSlot = DtoGEP(cacheType, cache, 0u, 0u);
+  auto failedSlot = DtoGEP(cacheType, cache, 0u, 1u);
+  auto loadSlot = [&](LLValue *slot) {
+    auto load = gIR->ir->CreateAlignedLoad(
+        ptrType, slot, gDataLayout->getPointerABIAlignment(0));
+    load->setAtomic(llvm::AtomicOrdering::Unordered);
+    return load;
+  };
+
+  auto endBB = gIR->insertBB("dyncast.end");
+  auto result = llvm::PHINode::Create(ptrType, 5, "dyncast", endBB);
+
+  auto notNullBB = gIR->insertBBAfter(gIR->scopebb(), "dyncast.notnull");
+  result->addIncoming(nullPtr, gIR->scopebb());
+  gIR->ir->CreateCondBr(gIR->ir->CreateICmpEQ(obj, nullPtr), endBB, notNullBB);
+
+  gIR->ir->SetInsertPoint(notNullBB);
+  auto vptr = DtoLoad(ptrType, obj, ".vptr");
+  if (isFinal) {
+    // The only class with the vtable of `cd`
+    auto vtbl = getIrAggr(cd)->getVtblSymbol();
+    auto cacheBB = gIR->insertBBAfter(notNullBB, "dyncast.cache");
+    result->addIncoming(obj, gIR->scopebb());
+    gIR->ir->CreateCondBr(gIR->ir->CreateICmpEQ(vptr, vtbl), endBB, cacheBB);
+    gIR->ir->SetInsertPoint(cacheBB);
+  }
+  auto classInfo = DtoLoad(ptrType, vptr, ".classinfo");
+  if (!isInterface) {
+    auto failedCheckBB = gIR->insertBBAfter(gIR->scopebb(), "dyncast.failed");
+    result->addIncoming(obj, gIR->scopebb());
+    gIR->ir->CreateCondBr(
+        gIR->ir->CreateICmpEQ(classInfo, loadSlot(succeededSlot)), endBB,
+        failedCheckBB);
+    gIR->ir->SetInsertPoint(failedCheckBB);
+  }
+  auto slowBB = gIR->insertBBAfter(gIR->scopebb(), "dyncast.slow");
+  result->addIncoming(nullPtr, gIR->scopebb());
+  gIR->ir->CreateCondBr(gIR->ir->CreateICmpEQ(classInfo, loadSlot(failedSlot)),
+                        endBB, slowBB);
+
+  gIR->ir->SetInsertPoint(slowBB);
+  auto func = getRuntimeFunction(loc, gIR->module, "_d_dynamic_cast");
+  LLValue *ret = gIR->CreateCallOrInvoke(func, obj, cinfo);
+  LLValue *slot = failedSlot;
+  if (isInterface) {
+    auto updateBB = gIR->insertBBAfter(gIR->scopebb(), "dyncast.update");
+    result->addIncoming(ret, gIR->scopebb());
+    gIR->ir->CreateCondBr(gIR->ir->CreateIsNull(ret), updateBB, endBB);
+    gIR->ir->SetInsertPoint(updateBB);
+  } else {
+    slot = gIR->ir->CreateSelect(gIR->ir->CreateIsNotNull(ret), succeededSlot,
+                                 failedSlot);
+  }
+  auto store = gIR->ir->CreateAlignedStore(
+      classInfo, slot, gDataLayout->getPointerABIAlignment(0));
+  store->setAtomic(llvm::AtomicOrdering::Unordered);
+  result->addIncoming(ret, gIR->scopebb());
+  gIR->ir->CreateBr(endBB);
+
+  gIR->ir->SetInsertPoint(endBB);
+  return result;
+}
+
 DValue *DtoDynamicCastObject(const Loc &loc, DValue *val, Type *_to) {
 
   resolveObjectAndClassInfoClasses();
@@ -389,13 +490,19 @@ DValue *DtoDynamicCastObject(const Loc &loc, DValue *val, Type *_to) {
   TypeClass *to = static_cast<TypeClass *>(_to->toBasetype());
   DtoResolveClass(to->sym);
 
-  LLValue *cinfo = getIrAggr(to->sym)->getClassInfoSymbol();
+  auto cinfo = getIrAggr(to->sym)->getClassInfoSymbol();
   assert(funcTy->getParamType(1) == cinfo->getType());
 
-  // call it
-  LLValue *ret = gIR->CreateCallOrInvoke(func, obj, cinfo);
+  // The inline checks need the ClassInfo at the start of the vtable
+  ClassDeclaration *from = val->type->toBasetype()->isTypeClass()->sym;
+  if (!isOptimizationEnabled() || from->vtblOffset() != 1 ||
+      to->sym->classKind != ClassKind::d) {
+    // call it
+    LLValue *ret = gIR->CreateCallOrInvoke(func, obj, cinfo);
+    return new DImValue(_to, ret);
+  }
 
-  return new DImValue(_to, ret);
+  return new DImValue(_to, emitInlineDynamicCast(loc, obj, to->sym, cinfo));
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -481,6 +588,14 @@ DtoVirtualFunctionPointer(DValue *inst, FuncDeclaration *fdecl) {
   vtable = DtoGEP(irtc->getMemoryLLType(), vthis, 0u, 0);
   // load vtbl ptr
   vtable = DtoLoad(vtblType->getPointerTo(), vtable);
+  // let whole-program devirtualization know about the class hierarchy
+  if (auto typeId = getVtblTypeId(tc->sym)) {
+    auto &ctx = gIR->context();
+    LLValue *typeTest =
+        gIR->ir->CreateCall(GET_INTRINSIC_DECL(type_test, {}),
+                            {vtable, llvm::MetadataAsValue::get(ctx, typeId)});
+    gIR->ir->CreateAssumption(typeTest);
+  }
   // index vtbl
   const std::string name = fdecl->toChars();
   const auto vtblname = name + "@vtbl";
@@ -502,3 +617,45 @@ DtoVirtualFunctionPointer(DValue *inst, FuncDeclaration *fdecl) {
 
   return std::make_pair(funcval, vtable);
 }
+
+////////////////////////////////////////////////////////////////////////////////
+
+llvm::MDString *getVtblTypeId(ClassDeclaration *cd) {
+  // A virtual call can only be devirtualized if all vtbls of subclasses are
+  // part of the LTO unit. Like clang, assume so for hidden classes with
+  // -fvisibility=hidden, but not for exported and druntime/Phobos classes
+  // (notably Object).
+  if (!opts::fWholeProgramVtables ||
+      opts::symbolVisibility != opts::SymbolVisibility::hidden) {
+    return nullptr;
+  }
+  if (cd->isInterfaceDeclaration() || cd->classKind != ClassKind::d ||
+      cd->isExport() || isDefaultLibSymbol(cd)) {
+    return nullptr;
+  }
+
+  const auto name = getIRMangledAggregateName(cd, nullptr);
+  return llvm::MDString::get(gIR->context(), name);
+}
+
+void addVtblTypeMetadata(ClassDeclaration *cd, llvm::GlobalVariable *vtbl) {
+  if (!opts::fWholeProgramVtables) {
+    return;
+  }
+
+  // The vtbl of a class starts with the vtbl entries of its base classes, so
+  // all type identifiers share the vtbl address as address point.
+  for (auto b = cd; b; b = b->baseClass) {
+    if (auto typeId = getVtblTypeId(b)) {
+      vtbl->addTypeMetadata(0, typeId);
+    }
+  }
+
+  // Exported classes may be derived from outside of the LTO unit, so they
+  // keep the default public visibility, which also inhibits the
+  // devirtualization of calls through their (hidden) base classes.
+  if (getVtblTypeId(cd)) {
+    vtbl->setVCallVisibilityMetadata(
+        llvm::GlobalObject::VCallVisibilityLinkageUnit);
+  }
+}
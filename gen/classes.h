@@ -24,6 +24,10 @@ class DValue;
 class FuncDeclaration;
 class NewExp;
 class TypeClass;
+namespace llvm {
+class GlobalVariable;
+class MDString;
+}
 
 /// Resolves the llvm type for a class declaration
 void DtoResolveClass(ClassDeclaration *cd);
@@ -44,3 +48,13 @@ bool DtoIsObjcLinkage(Type *to);
 /// Returns pair of function pointer and vtable pointer.
 std::pair<llvm::Value *, llvm::Value *>
 DtoVirtualFunctionPointer(DValue *inst, FuncDeclaration *fdecl);
+
+/// Returns the type identifier of the vtbls of the class for whole-program
+/// devirtualization (-fwhole-program-vtables), or null if virtual calls through
+/// the class cannot be devirtualized, e.g., because subclasses may live outside
+/// of the LTO unit.
+llvm::MDString *getVtblTypeId(ClassDeclaration *cd);
+
+/// Attaches the type identifiers of the class and its base classes to the
+/// class' vtbl definition (-fwhole-program-vtables).
+void addVtblTypeMetadata(ClassDeclaration *cd, llvm::GlobalVariable *vtbl);
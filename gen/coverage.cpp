@@ -9,70 +9,433 @@
 
 #include "gen/coverage.h"
 
+#include "dmd/mangle.h"
 #include "dmd/module.h"
 #include "driver/cl_options.h"
+#include "gen/abi/abi.h"
 #include "gen/irstate.h"
+#include "gen/llvmhelpers.h"
 #include "gen/logger.h"
+#include "gen/mangling.h"
+#include "gen/tollvm.h"
+#include "ir/irmodule.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include <algorithm>
+#include <map>
+#include <numeric>
 
-void emitCoverageLinecountInc(const Loc &loc) {
-  Module *m = gIR->dmodule;
+using namespace dmd;
 
-  // Only emit coverage increment for locations in the source of the current
-  // module
-  // (for example, 'inlined' methods from other source files should be skipped).
-  if (!global.params.cov || !loc.linnum() || !loc.filename() ||
-      !m->d_cover_data || strcmp(m->srcfile.toChars(), loc.filename()) != 0) {
-    return;
-  }
+namespace {
+// Placeholder for a line counter increment with -cov-edges, replaced by
+// emitCoverageEdgeCounters() at the end of the function.
+const char *const LineMarkerName = "ldc.cov.line";
 
-  const unsigned line = loc.linnum() - 1; // convert to 0-based line# index
-  assert(line < m->numlines);
-
-  IF_LOG Logger::println("Coverage: increment _d_cover_data[%d]", line);
-  LOG_SCOPE;
+bool useCoverageEdges() {
+  // Booleans can't be added up to line counts
+  return opts::coverageEdges &&
+         opts::coverageIncrement != opts::CoverageIncrement::boolean;
+}
 
-  // Increment the line counter:
-  // Get GEP into _d_cover_data array...
-  LLType *i32Type = LLType::getInt32Ty(gIR->context());
-  LLConstant *idxs[] = {DtoConstUint(0), DtoConstUint(line)};
-  LLValue *ptr = llvm::ConstantExpr::getGetElementPtr(
-      LLArrayType::get(i32Type, m->numlines), m->d_cover_data, idxs, true);
-  // ...and generate the "increment" instruction(s)
-  switch (opts::coverageIncrement) {
+// Generates the "increment" instruction(s) for a counter, according to
+// -cov-increment.
+void emitCounterIncrement(
+    llvm::IRBuilderBase &builder, LLValue *ptr,
+    opts::CoverageIncrement increment = opts::coverageIncrement) {
+  LLType *i32Type = builder.getInt32Ty();
+  switch (increment) {
   case opts::CoverageIncrement::_default: // fallthrough
   case opts::CoverageIncrement::atomic:
     // Do an atomic increment, so this works when multiple threads are executed.
-    gIR->ir->CreateAtomicRMW(llvm::AtomicRMWInst::Add, ptr, DtoConstUint(1),
-                             llvm::Align(4), llvm::AtomicOrdering::Monotonic);
+    builder.CreateAtomicRMW(llvm::AtomicRMWInst::Add, ptr, DtoConstUint(1),
+                            llvm::Align(4), llvm::AtomicOrdering::Monotonic);
     break;
   case opts::CoverageIncrement::nonatomic: {
     // Do a non-atomic increment, user is responsible for correct results with
     // multithreaded execution
-    llvm::LoadInst *load =
-        gIR->ir->CreateAlignedLoad(i32Type, ptr, llvm::Align(4));
-    llvm::StoreInst *store = gIR->ir->CreateAlignedStore(
-        gIR->ir->CreateAdd(load, DtoConstUint(1)), ptr, llvm::Align(4));
+    llvm::LoadInst *load = builder.CreateAlignedLoad(i32Type, ptr, llvm::Align(4));
+    llvm::StoreInst *store = builder.CreateAlignedStore(
+        builder.CreateAdd(load, DtoConstUint(1)), ptr, llvm::Align(4));
     // add !nontemporal attribute, to inform the optimizer that caching is not
     // needed
     llvm::MDNode *node = llvm::MDNode::get(
-        gIR->context(), llvm::ConstantAsMetadata::get(DtoConstInt(1)));
+        builder.getContext(), llvm::ConstantAsMetadata::get(DtoConstInt(1)));
     load->setMetadata("nontemporal", node);
     store->setMetadata("nontemporal", node);
     break;
   }
+  case opts::CoverageIncrement::sharded: {
+    // Do a non-atomic increment of the thread-local counter; the optimizer is
+    // free to keep the count in a register within loops, as the counters
+    // don't escape.
+    llvm::LoadInst *load = builder.CreateAlignedLoad(i32Type, ptr, llvm::Align(4));
+    builder.CreateAlignedStore(builder.CreateAdd(load, DtoConstUint(1)), ptr,
+                               llvm::Align(4));
+    break;
+  }
   case opts::CoverageIncrement::boolean: {
     // Do a boolean set, avoiding a memory read (blocking) and threading issues
     // at the cost of not "counting"
     llvm::StoreInst *store =
-        gIR->ir->CreateAlignedStore(DtoConstUint(1), ptr, llvm::Align(4));
+        builder.CreateAlignedStore(DtoConstUint(1), ptr, llvm::Align(4));
     // add !nontemporal attribute, to inform the optimizer that caching is not
     // needed
     llvm::MDNode *node = llvm::MDNode::get(
-        gIR->context(), llvm::ConstantAsMetadata::get(DtoConstInt(1)));
+        builder.getContext(), llvm::ConstantAsMetadata::get(DtoConstInt(1)));
     store->setMetadata("nontemporal", node);
     break;
   }
   }
+}
+
+// Returns the GEP into the _d_cover_data array (or its thread-local shard).
+LLConstant *getLineCounter(Module *m, unsigned line) {
+  llvm::GlobalVariable *counters = m->d_cover_data;
+  if (auto tlsData = getIrModule(m)->coverageTlsData) {
+    counters = tlsData;
+  }
+  LLType *i32Type = LLType::getInt32Ty(gIR->context());
+  LLConstant *idxs[] = {DtoConstUint(0), DtoConstUint(line)};
+  return llvm::ConstantExpr::getGetElementPtr(
+      LLArrayType::get(i32Type, m->numlines), counters, idxs, true);
+}
+
+// Replaces a line marker which couldn't be turned into edge counters by a line
+// counter increment. With -cov-increment=sharded and -cov-edges, the line
+// counters aren't sharded (only the edge counters are), so they are
+// incremented atomically.
+void replaceByLineCounter(llvm::CallInst *marker, Module *m) {
+  const auto line = static_cast<unsigned>(
+      llvm::cast<llvm::ConstantInt>(marker->getArgOperand(0))->getZExtValue());
+  opts::CoverageIncrement increment = opts::coverageIncrement;
+  if (increment == opts::CoverageIncrement::sharded &&
+      !getIrModule(m)->coverageTlsData) {
+    increment = opts::CoverageIncrement::atomic;
+  }
+  llvm::IRBuilder<> builder(marker);
+  emitCounterIncrement(builder, getLineCounter(m, line), increment);
+  marker->eraseFromParent();
+}
+
+LLConstant *getEdgeCounter(IrModule &irm, unsigned index) {
+  return llvm::ConstantExpr::getInBoundsGetElementPtr(
+      LLType::getInt32Ty(gIR->context()), irm.coverageEdges,
+      DtoConstUint(index));
+}
+
+llvm::Function *getLineMarker() {
+  auto marker = gIR->module.getFunction(LineMarkerName);
+  if (!marker) {
+    auto &context = gIR->context();
+    marker = llvm::Function::Create(
+        llvm::FunctionType::get(LLType::getVoidTy(context),
+                                {LLType::getInt32Ty(context)}, false),
+        LLGlobalValue::ExternalLinkage, LineMarkerName, &gIR->module);
+    marker->setDoesNotThrow();
+  }
+  return marker;
+}
+
+bool mayThrow(const llvm::Instruction &inst) {
+  auto call = llvm::dyn_cast<llvm::CallInst>(&inst);
+  return call && !call->doesNotThrow() && !call->getIntrinsicID();
+}
+
+/// The control flow graph of a function used to select the minimal set of
+/// counters: the edges not in a maximum spanning tree (Knuth, "Optimal
+/// measurement points for program frequency counts"). The counts of the tree
+/// edges follow from the flow conservation at each node.
+///
+/// A block with calls which may throw is split into an `in` and an `out` node,
+/// connected by an edge counting the executions reaching the end of the block
+/// and a fake edge to the exit node for the ones leaving by an exception.
+/// The exit node is connected to the entry block by a virtual edge.
+class CoverageGraph {
+public:
+  struct Edge {
+    unsigned src, dst;
+    // Where a counter for this edge is placed:
+    // - at the start of `dstBB` if `srcBB` is null (virtual edge),
+    // - at the end of `srcBB` if `dstBB` is null (exit and internal edges),
+    // - on the edge from `srcBB` to `dstBB` otherwise.
+    // Not instrumentable if both are null (fake edge).
+    llvm::BasicBlock *srcBB = nullptr, *dstBB = nullptr;
+    unsigned weight = 0;
+    bool inTree = false;
+    int counter = -1;
+    // The count as linear combination of the counters
+    std::map<unsigned, int64_t> count;
+  };
+
+  explicit CoverageGraph(llvm::Function &func);
+
+  // Selects the counters, returns false if an edge which can't be
+  // instrumented would be needed.
+  bool selectCounters();
+  // Computes the counts of all edges from the counters.
+  void solve();
+  // Places the counters, numbered from `firstCounter`.
+  void placeCounters(IrModule &irm, unsigned firstCounter);
+
+  std::map<unsigned, int64_t> getNodeCount(unsigned node) const;
+  unsigned getInNode(llvm::BasicBlock *bb) const { return inNodes.lookup(bb); }
+  unsigned getOutNode(llvm::BasicBlock *bb) const {
+    return outNodes.lookup(bb);
+  }
+  unsigned getCountersCount() const { return countersCount; }
+
+private:
+  llvm::Function &func;
+  llvm::DenseMap<llvm::BasicBlock *, unsigned> inNodes, outNodes;
+  unsigned nodesCount = 0;
+  unsigned exitNode = 0;
+  unsigned countersCount = 0;
+  std::vector<Edge> edges;
+
+  bool isInstrumentable(const Edge &edge) const;
+  void addEdge(unsigned src, unsigned dst, llvm::BasicBlock *srcBB,
+               llvm::BasicBlock *dstBB, unsigned weight) {
+    Edge edge;
+    edge.src = src;
+    edge.dst = dst;
+    edge.srcBB = srcBB;
+    edge.dstBB = dstBB;
+    edge.weight = weight;
+    edges.push_back(std::move(edge));
+  }
+};
+
+CoverageGraph::CoverageGraph(llvm::Function &func) : func(func) {
+  for (auto &bb : func) {
+    inNodes[&bb] = nodesCount;
+    const bool split = std::any_of(bb.begin(), bb.end(), mayThrow);
+    outNodes[&bb] = split ? nodesCount + 1 : nodesCount;
+    nodesCount += split ? 2 : 1;
+  }
+  exitNode = nodesCount++;
+
+  // Prefer edges in loops for the tree, so the hot ones get no counter
+  llvm::DominatorTree domTree(func);
+  llvm::LoopInfo loopInfo(domTree);
+
+  for (auto &bb : func) {
+    const unsigned depth = loopInfo.getLoopDepth(&bb);
+    if (inNodes[&bb] != outNodes[&bb]) {
+      addEdge(inNodes[&bb], exitNode, nullptr, nullptr, 0);
+      addEdge(inNodes[&bb], outNodes[&bb], &bb, nullptr, 2 * depth);
+    }
+    llvm::SmallPtrSet<llvm::BasicBlock *, 4> visited;
+    for (auto succ : llvm::successors(&bb)) {
+      if (visited.insert(succ).second) {
+        addEdge(outNodes[&bb], inNodes[succ], &bb, succ,
+                depth + loopInfo.getLoopDepth(succ));
+      }
+    }
+    if (visited.empty()) {
+      addEdge(outNodes[&bb], exitNode, &bb, nullptr, 0);
+    }
+  }
+  addEdge(exitNode, inNodes[&func.getEntryBlock()], nullptr,
+          &func.getEntryBlock(), 0);
+}
+
+bool CoverageGraph::isInstrumentable(const Edge &edge) const {
+  if (!edge.srcBB || !edge.dstBB) {
+    return edge.srcBB || edge.dstBB;
+  }
+  if (edge.srcBB->getUniqueSuccessor() || edge.dstBB->getUniquePredecessor()) {
+    return true;
+  }
+  // Critical edge, needs to be split
+  auto term = edge.srcBB->getTerminator();
+  return !edge.dstBB->isEHPad() && !llvm::isa<llvm::IndirectBrInst>(term) &&
+         !llvm::isa<llvm::CallBrInst>(term);
+}
+
+bool CoverageGraph::selectCounters() {
+  std::vector<unsigned> order(edges.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::vector<bool> instrumentable(edges.size());
+  for (size_t i = 0; i < edges.size(); ++i) {
+    instrumentable[i] = isInstrumentable(edges[i]);
+  }
+  // Edges which can't be instrumented first, then the heaviest ones
+  std::stable_sort(order.begin(), order.end(), [&](unsigned a, unsigned b) {
+    if (instrumentable[a] != instrumentable[b]) {
+      return !instrumentable[a];
+    }
+    return edges[a].weight > edges[b].weight;
+  });
+
+  // Kruskal's algorithm
+  std::vector<unsigned> parent(nodesCount);
+  std::iota(parent.begin(), parent.end(), 0);
+  auto find = [&](unsigned node) {
+    while (parent[node] != node) {
+      node = parent[node] = parent[parent[node]];
+    }
+    return node;
+  };
+
+  for (auto i : order) {
+    auto &edge = edges[i];
+    const auto srcRoot = find(edge.src);
+    const auto dstRoot = find(edge.dst);
+    if (srcRoot != dstRoot) {
+      parent[srcRoot] = dstRoot;
+      edge.inTree = true;
+    } else if (!instrumentable[i]) {
+      return false;
+    } else {
+      edge.counter = countersCount++;
+      edge.count[edge.counter] = 1;
+    }
+  }
+  return true;
+}
+
+void CoverageGraph::solve() {
+  // Peel off the leaves of the spanning tree: at a node with a single unknown
+  // edge, its count is the difference of the other incoming and outgoing
+  // counts.
+  std::vector<std::vector<unsigned>> incident(nodesCount);
+  std::vector<unsigned> unknown(nodesCount);
+  for (unsigned i = 0; i < edges.size(); ++i) {
+    incident[edges[i].src].push_back(i);
+    if (edges[i].dst != edges[i].src) {
+      incident[edges[i].dst].push_back(i);
+    }
+    if (edges[i].inTree) {
+      ++unknown[edges[i].src];
+      ++unknown[edges[i].dst];
+    }
+  }
+
+  std::vector<bool> solved(edges.size());
+  for (unsigned i = 0; i < edges.size(); ++i) {
+    solved[i] = !edges[i].inTree;
+  }
+
+  std::vector<unsigned> worklist;
+  for (unsigned node = 0; node < nodesCount; ++node) {
+    if (unknown[node] == 1) {
+      worklist.push_back(node);
+    }
+  }
+  while (!worklist.empty()) {
+    const auto node = worklist.back();
+    worklist.pop_back();
+    if (unknown[node] != 1) {
+      continue;
+    }
+
+    int target = -1;
+    std::map<unsigned, int64_t> sum; // incoming - outgoing
+    for (auto i : incident[node]) {
+      const auto &edge = edges[i];
+      if (!solved[i]) {
+        target = i;
+        continue;
+      }
+      if (edge.src == edge.dst) {
+        continue;
+      }
+      const int64_t sign = edge.dst == node ? 1 : -1;
+      for (const auto &term : edge.count) {
+        sum[term.first] += sign * term.second;
+      }
+    }
+    assert(target >= 0);
+
+    auto &edge = edges[target];
+    const int64_t sign = edge.dst == node ? -1 : 1;
+    for (const auto &term : sum) {
+      if (term.second != 0) {
+        edge.count[term.first] = sign * term.second;
+      }
+    }
+    solved[target] = true;
+    --unknown[edge.src];
+    --unknown[edge.dst];
+    const auto other = edge.src == node ? edge.dst : edge.src;
+    if (unknown[other] == 1) {
+      worklist.push_back(other);
+    }
+  }
+}
+
+std::map<unsigned, int64_t> CoverageGraph::getNodeCount(unsigned node) const {
+  std::map<unsigned, int64_t> ret;
+  for (const auto &edge : edges) {
+    if (edge.dst == node) {
+      for (const auto &term : edge.count) {
+        ret[term.first] += term.second;
+      }
+    }
+  }
+  return ret;
+}
+
+void CoverageGraph::placeCounters(IrModule &irm, unsigned firstCounter) {
+  for (const auto &edge : edges) {
+    if (edge.counter < 0) {
+      continue;
+    }
+    auto counter = getEdgeCounter(irm, firstCounter + edge.counter);
+    llvm::IRBuilder<> builder(func.getContext());
+    if (!edge.srcBB) {
+      auto it = edge.dstBB->getFirstInsertionPt();
+      while (llvm::isa<llvm::AllocaInst>(*it)) {
+        ++it;
+      }
+      builder.SetInsertPoint(edge.dstBB, it);
+    } else if (!edge.dstBB || edge.srcBB->getUniqueSuccessor()) {
+      builder.SetInsertPoint(edge.srcBB->getTerminator());
+    } else if (edge.dstBB->getUniquePredecessor()) {
+      builder.SetInsertPoint(edge.dstBB, edge.dstBB->getFirstInsertionPt());
+    } else {
+      auto term = edge.srcBB->getTerminator();
+      unsigned index = 0;
+      while (term->getSuccessor(index) != edge.dstBB) {
+        ++index;
+      }
+      auto newBB = llvm::SplitCriticalEdge(
+          term, index,
+          llvm::CriticalEdgeSplittingOptions().setMergeIdenticalEdges());
+      assert(newBB);
+      builder.SetInsertPoint(newBB->getTerminator());
+    }
+    emitCounterIncrement(builder, counter);
+  }
+}
+} // anonymous namespace
+
+void emitCoverageLinecountInc(const Loc &loc) {
+  Module *m = gIR->dmodule;
+
+  // Only emit coverage increment for locations in the source of the current
+  // module
+  // (for example, 'inlined' methods from other source files should be skipped).
+  if (!global.params.cov || !loc.linnum() || !loc.filename() ||
+      !m->d_cover_data || strcmp(m->srcfile.toChars(), loc.filename()) != 0) {
+    return;
+  }
+
+  const unsigned line = loc.linnum() - 1; // convert to 0-based line# index
+  assert(line < m->numlines);
+
+  IF_LOG Logger::println("Coverage: increment _d_cover_data[%d]", line);
+  LOG_SCOPE;
+
+  if (useCoverageEdges()) {
+    // The counters are chosen once the function is complete
+    gIR->ir->CreateCall(getLineMarker(), {DtoConstUint(line)});
+  } else {
+    emitCounterIncrement(*gIR->ir.operator->(), getLineCounter(m, line));
+  }
 
   // Set the 'counter valid' bit to 1 for this line of code
   unsigned num_sizet_bits = gDataLayout->getTypeSizeInBits(DtoSize_t());
@@ -81,3 +444,266 @@ void emitCoverageLinecountInc(const Loc &loc) {
   IF_LOG Logger::println("_d_cover_valid[%d] |= (1 << %d)", idx, bitidx);
   m->d_cover_valid_init[idx] |= (size_t(1) << bitidx);
 }
+
+void emitCoverageEdgeCounters(llvm::Function &func) {
+  auto marker = gIR->module.getFunction(LineMarkerName);
+  if (!marker) {
+    return;
+  }
+
+  // The markers and the nodes of the blocks they're in. Those after a call
+  // which may throw are counted by the `out` node of the block.
+  std::vector<std::pair<llvm::CallInst *, bool>> markers;
+  bool hasFunclets = false;
+  for (auto &bb : func) {
+    bool afterThrowingCall = false;
+    for (auto &inst : bb) {
+      auto call = llvm::dyn_cast<llvm::CallInst>(&inst);
+      if (call && call->getCalledFunction() == marker) {
+        markers.emplace_back(call, afterThrowingCall);
+      } else if (mayThrow(inst)) {
+        afterThrowingCall = true;
+      }
+      hasFunclets |= llvm::isa<llvm::FuncletPadInst>(inst) ||
+                     llvm::isa<llvm::CatchSwitchInst>(inst);
+    }
+  }
+  if (markers.empty()) {
+    return;
+  }
+
+  Module *m = gIR->dmodule;
+  IrModule &irm = *getIrModule(m);
+  IF_LOG Logger::println("Coverage: select edge counters for %s",
+                         func.getName().str().c_str());
+  LOG_SCOPE;
+
+  auto replaceByLineCounters = [&]() {
+    IF_LOG Logger::println("Using line counters");
+    for (const auto &entry : markers) {
+      replaceByLineCounter(entry.first, m);
+    }
+  };
+
+  // MSVC EH funclets can't be split into edges
+  if (hasFunclets) {
+    replaceByLineCounters();
+    return;
+  }
+
+  CoverageGraph graph(func);
+  if (!graph.selectCounters()) {
+    replaceByLineCounters();
+    return;
+  }
+  graph.solve();
+
+  // Each line count is the sum of the counts of the nodes the line is in
+  const unsigned firstCounter = irm.coverageEdgesCount;
+  std::map<std::pair<unsigned, unsigned>, int64_t> lineCoefficients;
+  for (const auto &entry : markers) {
+    auto call = entry.first;
+    const auto line = static_cast<unsigned>(
+        llvm::cast<llvm::ConstantInt>(call->getArgOperand(0))->getZExtValue());
+    auto bb = call->getParent();
+    const auto node =
+        entry.second ? graph.getOutNode(bb) : graph.getInNode(bb);
+    for (const auto &term : graph.getNodeCount(node)) {
+      lineCoefficients[{firstCounter + term.first, line}] += term.second;
+    }
+    call->eraseFromParent();
+  }
+  for (const auto &entry : lineCoefficients) {
+    if (entry.second != 0) {
+      irm.coverageEdgeLines.push_back(
+          {entry.first.first, entry.first.second,
+           static_cast<int32_t>(entry.second)});
+    }
+  }
+
+  graph.placeCounters(irm, firstCounter);
+  irm.coverageEdgesCount += graph.getCountersCount();
+  IF_LOG Logger::println("%u counters for %zu line counters",
+                         graph.getCountersCount(), markers.size());
+}
+
+void addCoverageEdges(Module *m) {
+  if (!useCoverageEdges() || m->numlines == 0) {
+    return;
+  }
+
+  IrModule &irm = *getIrModule(m);
+  const bool sharded =
+      opts::coverageIncrement == opts::CoverageIncrement::sharded;
+
+  // The placeholder for the counters, replaced once their number is known
+  irm.coverageEdges = declareGlobal(
+      Loc(), gIR->module, LLArrayType::get(LLType::getInt32Ty(gIR->context()), 0),
+      "_d_cover_edges", /*isConstant=*/false, /*isThreadLocal=*/sharded,
+      /*useDLLImport=*/false);
+
+  // The function computing the line counts, registered with druntime by the
+  // coverage ctor; run right before the report is written, and at the exit of
+  // each thread for thread-local counters. Its body is built once the
+  // counters are known.
+  OutBuffer mangleBuf;
+  mangleBuf.writestring("_D");
+  mangleToBuffer(m, mangleBuf);
+  mangleBuf.writestring("14_coverageMergeFZv");
+  const char *name = mangleBuf.peekChars();
+
+  LLFunctionType *mergeTy =
+      LLFunctionType::get(LLType::getVoidTy(gIR->context()), {}, false);
+  auto merge =
+      LLFunction::Create(mergeTy, LLGlobalValue::InternalLinkage,
+                         getIRMangledFuncName(name, LINK::d), &gIR->module);
+  merge->setCallingConv(gABI->callingConv(LINK::c));
+  if (global.params.targetTriple->getArch() == llvm::Triple::x86_64) {
+    merge->setUWTableKind(llvm::UWTableKind::Default);
+  }
+  irm.coverageMerge = merge;
+}
+
+void finalizeCoverageEdges(Module *m) {
+  IrModule &irm = *getIrModule(m);
+  if (!irm.coverageEdges) {
+    return;
+  }
+
+  // Functions not defined by DtoDefineFunction() keep their line counters
+  if (auto marker = gIR->module.getFunction(LineMarkerName)) {
+    while (!marker->use_empty()) {
+      replaceByLineCounter(llvm::cast<llvm::CallInst>(marker->user_back()), m);
+    }
+    marker->eraseFromParent();
+  }
+
+  IF_LOG Logger::println("Build coverage edge counters: uint[%u] _d_cover_edges",
+                         irm.coverageEdgesCount);
+  LOG_SCOPE;
+
+  auto &context = gIR->context();
+  auto i32Type = LLType::getInt32Ty(context);
+  const bool sharded =
+      opts::coverageIncrement == opts::CoverageIncrement::sharded;
+  const bool atomic =
+      opts::coverageIncrement == opts::CoverageIncrement::_default ||
+      opts::coverageIncrement == opts::CoverageIncrement::atomic;
+
+  // Replace the placeholder by the actual array
+  const unsigned count = irm.coverageEdgesCount;
+  auto placeholder = irm.coverageEdges;
+  placeholder->setName("");
+  auto countersType = LLArrayType::get(i32Type, count);
+  auto counters = defineGlobal(Loc(), gIR->module, "_d_cover_edges",
+                               llvm::ConstantAggregateZero::get(countersType),
+                               LLGlobalValue::InternalLinkage,
+                               /*isConstant=*/false, /*isThreadLocal=*/sharded);
+  placeholder->replaceAllUsesWith(counters);
+  placeholder->eraseFromParent();
+  irm.coverageEdges = counters;
+
+  auto merge = irm.coverageMerge;
+  auto entryBB = llvm::BasicBlock::Create(context, "", merge);
+  IRBuilder<> builder(entryBB);
+  if (count == 0) {
+    builder.CreateRetVoid();
+    return;
+  }
+
+  // The (line, coefficient) pairs of each counter, indexed by offsets[counter]
+  auto &lines = irm.coverageEdgeLines;
+  std::stable_sort(lines.begin(), lines.end(),
+                   [](const IrModule::CoverageEdgeLine &a,
+                      const IrModule::CoverageEdgeLine &b) {
+                     return a.counter < b.counter;
+                   });
+  std::vector<uint32_t> offsetsData(count + 1);
+  std::vector<uint32_t> linesData;
+  linesData.reserve(2 * lines.size());
+  for (const auto &entry : lines) {
+    ++offsetsData[entry.counter + 1];
+    linesData.push_back(entry.line);
+    linesData.push_back(static_cast<uint32_t>(entry.coefficient));
+  }
+  std::partial_sum(offsetsData.begin(), offsetsData.end(), offsetsData.begin());
+
+  auto offsets = new llvm::GlobalVariable(
+      gIR->module, LLArrayType::get(i32Type, count + 1), true,
+      LLGlobalValue::PrivateLinkage,
+      llvm::ConstantDataArray::get(context, offsetsData),
+      "_d_cover_edges_offsets");
+  auto linesTable = new llvm::GlobalVariable(
+      gIR->module, LLArrayType::get(i32Type, linesData.size()), true,
+      LLGlobalValue::PrivateLinkage,
+      llvm::ConstantDataArray::get(context, linesData), "_d_cover_edges_lines");
+
+  /* Add the counts of the lines to _d_cover_data and reset the counters:
+   *   foreach (c; 0 .. count) {
+   *     const n = atomicExchange(&_d_cover_edges[c], 0);
+   *     if (n != 0)
+   *       foreach (j; offsets[c] .. offsets[c + 1])
+   *         atomicOp!"+="(_d_cover_data[lines[2*j]], lines[2*j+1] * n);
+   *   }
+   * The counts are linear in the counters, so the totals are exact even if
+   * other threads still increment them.
+   */
+  auto counterBB = llvm::BasicBlock::Create(context, "counter", merge);
+  auto linesBB = llvm::BasicBlock::Create(context, "lines", merge);
+  auto lineBB = llvm::BasicBlock::Create(context, "line", merge);
+  auto nextBB = llvm::BasicBlock::Create(context, "next", merge);
+  auto endBB = llvm::BasicBlock::Create(context, "end", merge);
+  builder.CreateBr(counterBB);
+
+  builder.SetInsertPoint(counterBB);
+  auto c = builder.CreatePHI(i32Type, 2, "c");
+  c->addIncoming(DtoConstUint(0), entryBB);
+  auto counter = builder.CreateInBoundsGEP(i32Type, counters, c);
+  LLValue *n;
+  if (atomic) {
+    n = builder.CreateAtomicRMW(llvm::AtomicRMWInst::Xchg, counter,
+                                DtoConstUint(0), llvm::Align(4),
+                                llvm::AtomicOrdering::Monotonic);
+  } else {
+    n = builder.CreateAlignedLoad(i32Type, counter, llvm::Align(4));
+    builder.CreateAlignedStore(DtoConstUint(0), counter, llvm::Align(4));
+  }
+  auto begin = builder.CreateAlignedLoad(
+      i32Type, builder.CreateInBoundsGEP(i32Type, offsets, c), llvm::Align(4));
+  auto c1 = builder.CreateAdd(c, DtoConstUint(1));
+  auto end = builder.CreateAlignedLoad(
+      i32Type, builder.CreateInBoundsGEP(i32Type, offsets, c1), llvm::Align(4));
+  builder.CreateCondBr(builder.CreateIsNotNull(n), linesBB, nextBB);
+
+  builder.SetInsertPoint(linesBB);
+  builder.CreateCondBr(builder.CreateICmpULT(begin, end), lineBB, nextBB);
+
+  builder.SetInsertPoint(lineBB);
+  auto j = builder.CreatePHI(i32Type, 2, "j");
+  j->addIncoming(begin, linesBB);
+  auto j2 = builder.CreateShl(j, 1);
+  auto line = builder.CreateAlignedLoad(
+      i32Type, builder.CreateInBoundsGEP(i32Type, linesTable, j2),
+      llvm::Align(4));
+  auto coefficient = builder.CreateAlignedLoad(
+      i32Type,
+      builder.CreateInBoundsGEP(i32Type, linesTable,
+                                builder.CreateOr(j2, DtoConstUint(1))),
+      llvm::Align(4));
+  builder.CreateAtomicRMW(
+      llvm::AtomicRMWInst::Add,
+      builder.CreateInBoundsGEP(i32Type, m->d_cover_data, line),
+      builder.CreateMul(coefficient, n), llvm::Align(4),
+      llvm::AtomicOrdering::Monotonic);
+  auto j1 = builder.CreateAdd(j, DtoConstUint(1));
+  j->addIncoming(j1, lineBB);
+  builder.CreateCondBr(builder.CreateICmpULT(j1, end), lineBB, nextBB);
+
+  builder.SetInsertPoint(nextBB);
+  c->addIncoming(c1, nextBB);
+  builder.CreateCondBr(builder.CreateICmpEQ(c1, DtoConstUint(count)), endBB,
+                       counterBB);
+
+  builder.SetInsertPoint(endBB);
+  builder.CreateRetVoid();
+}
@@ -15,5 +15,21 @@
 #pragma once
 
 struct Loc;
+class Module;
+namespace llvm {
+class Function;
+}
 
 void emitCoverageLinecountInc(const Loc &loc);
+
+/// -cov-edges: replaces the line counter increments of a completely generated
+/// function by counters on a minimal set of control flow edges.
+void emitCoverageEdgeCounters(llvm::Function &func);
+
+/// -cov-edges: declares the module's edge counters and the merge function
+/// adding the reconstructed line counts to _d_cover_data.
+void addCoverageEdges(Module *m);
+
+/// -cov-edges: defines the edge counters and the merge function, once all
+/// functions of the module have been generated.
+void finalizeCoverageEdges(Module *m);
@@ -367,7 +367,7 @@ llvm::Constant *getArrayPtr(llvm::Type *type, llvm::Constant *array) {
 llvm::Constant *getI8Ptr(llvm::GlobalValue *val) {
   assert(nullptr != val);
   return llvm::ConstantExpr::getBitCast(
-      val, llvm::IntegerType::getInt8PtrTy(val->getContext()));
+      val, llvm::PointerType::getUnqual(val->getContext()));
 }
 
 std::pair<llvm::Constant *, llvm::Constant *>
@@ -410,7 +410,7 @@ llvm::Constant *createStringInitializer(llvm::Module &mod,
       true, llvm::GlobalValue::PrivateLinkage,
       llvm::ConstantDataArray::getString(mod.getContext(), str, true), ".str");
   return llvm::ConstantExpr::getBitCast(
-      nameVar, llvm::Type::getInt8PtrTy(mod.getContext()));
+      nameVar, llvm::PointerType::getUnqual(mod.getContext()));
 }
 
 // void createStaticString(llvm::Module& mod,
@@ -441,8 +441,8 @@ llvm::Constant *createStringInitializer(llvm::Module &mod,
 
 llvm::StructType *getVarListElemType(llvm::LLVMContext &context) {
   llvm::Type *elements[] = {
-      llvm::IntegerType::getInt8PtrTy(context),
-      llvm::IntegerType::getInt8PtrTy(context),
+      llvm::PointerType::getUnqual(context),
+      llvm::PointerType::getUnqual(context),
   };
   return llvm::StructType::create(context, elements, /*"RtCompileVarList"*/ "",
                                   true);
@@ -456,8 +456,8 @@ llvm::StructType *getVarListElemType(llvm::LLVMContext &context) {
 
 llvm::StructType *getSymListElemType(llvm::LLVMContext &context) {
   llvm::Type *elements[] = {
-      llvm::IntegerType::getInt8PtrTy(context),
-      llvm::IntegerType::getInt8PtrTy(context),
+      llvm::PointerType::getUnqual(context),
+      llvm::PointerType::getUnqual(context),
   };
   return llvm::StructType::create(context, elements, /*"RtCompileSymList"*/ "",
                                   true);
@@ -468,13 +468,15 @@ llvm::StructType *getSymListElemType(llvm::LLVMContext &context) {
 //   i8* name;
 //   i8* func;
 //   i8* originalFunc;
+//   i8* staticFunc;
 // };
 
 llvm::StructType *getFuncListElemType(llvm::LLVMContext &context) {
   llvm::Type *elements[] = {
-      llvm::IntegerType::getInt8PtrTy(context),
-      llvm::IntegerType::getInt8PtrTy(context),
-      llvm::IntegerType::getInt8PtrTy(context),
+      llvm::PointerType::getUnqual(context),
+      llvm::PointerType::getUnqual(context),
+      llvm::PointerType::getUnqual(context),
+      llvm::PointerType::getUnqual(context),
   };
   return llvm::StructType::create(context, elements, /*"RtCompileFuncList"*/ "",
                                   true);
@@ -504,7 +506,7 @@ llvm::StructType *getModuleListElemType(llvm::LLVMContext &context,
   llvm::Type *elements[] = {
       llvm::IntegerType::get(context, 32),
       llvm::PointerType::getUnqual(ret),
-      llvm::IntegerType::getInt8PtrTy(context),
+      llvm::PointerType::getUnqual(context),
       llvm::IntegerType::get(context, 32),
       llvm::PointerType::getUnqual(funcListElemType),
       llvm::IntegerType::get(context, 32),
@@ -548,6 +550,7 @@ generateFuncList(IRState *irs, const Types &types,
         createStringInitializer(irs->module, name),
         getI8Ptr(it.second.thunkVar),
         getI8Ptr(it.second.thunkFunc),
+        getI8Ptr(it.first),
     };
     elements.push_back(
         llvm::ConstantStruct::get(types.funcListElemType, fields));
@@ -564,6 +567,7 @@ generateFuncList(IRState *irs, const Types &types,
           createStringInitializer(irs->module, name),
           nullp,
           getI8Ptr(func),
+          nullp,
       };
       elements.push_back(
           llvm::ConstantStruct::get(types.funcListElemType, fields));
@@ -659,7 +663,7 @@ llvm::GlobalVariable *generateModuleListElem(IRState *irs, const Types &types,
 llvm::PointerType *getModListHeadType(llvm::LLVMContext &context,
                                       const Types &types) {
   (void)types;
-  return llvm::IntegerType::getInt8PtrTy(context);
+  return llvm::PointerType::getUnqual(context);
 }
 
 llvm::GlobalVariable *declareModListHead(llvm::Module &module,
@@ -685,12 +689,11 @@ void generateCtorBody(IRState *irs, const Types &types, llvm::Function *func,
   auto elemIndex = llvm::ConstantInt::get(irs->context(), APInt(32, 1));
   auto modListHeadPtr = declareModListHead(irs->module, types);
   llvm::Value *gepVals[] = {zero64, elemIndex};
-  auto elemNextPtr = builder.CreateGEP(modListElem, gepVals);
-  auto prevHeadVal = builder.CreateLoad(builder.CreateBitOrPointerCast(
-      modListHeadPtr, types.modListElemType->getPointerTo()->getPointerTo()));
-  auto voidPtr = builder.CreateBitOrPointerCast(
-      modListElem, llvm::IntegerType::getInt8PtrTy(irs->context()));
-  builder.CreateStore(voidPtr, modListHeadPtr);
+  auto elemNextPtr =
+      builder.CreateGEP(types.modListElemType, modListElem, gepVals);
+  auto prevHeadVal =
+      builder.CreateLoad(modListHeadPtr->getValueType(), modListHeadPtr);
+  builder.CreateStore(modListElem, modListHeadPtr);
   builder.CreateStore(prevHeadVal, elemNextPtr);
 
   builder.CreateRetVoid();
@@ -721,7 +724,7 @@ void setupModuleBitcodeData(const llvm::Module &srcModule, IRState *irs,
   llvm::WriteBitcodeToFile(srcModule, os);
 
   auto runtimeCompiledIr = new llvm::GlobalVariable(
-      irs->module, llvm::Type::getInt8PtrTy(irs->context()), true,
+      irs->module, llvm::PointerType::getUnqual(irs->context()), true,
       llvm::GlobalValue::PrivateLinkage, nullptr, ".rtcompile_ir");
 
   auto runtimeCompiledIrSize = new llvm::GlobalVariable(
@@ -761,7 +764,7 @@ void createThunkFunc(llvm::Module &module, const llvm::Function *src,
   auto bb = llvm::BasicBlock::Create(module.getContext(), "", dst);
   llvm::IRBuilder<> builder(module.getContext());
   builder.SetInsertPoint(bb);
-  auto thunkPtr = builder.CreateLoad(thunkVar);
+  auto thunkPtr = builder.CreateLoad(thunkVar->getValueType(), thunkVar);
   llvm::SmallVector<llvm::Value *, 6> args;
   for (auto &arg : dst->args()) {
     args.push_back(&arg);
@@ -835,11 +838,12 @@ void defineDynamicCompiledFunction(IRState *irs, IrFunction *func) {
     auto srcFunc = func->getLLVMFunc();
     auto it = irs->dynamicCompiledFunctions.find(srcFunc);
     assert(irs->dynamicCompiledFunctions.end() != it);
-    auto thunkVarType = srcFunc->getFunctionType()->getPointerTo();
+    // Calls made before the jitted version is available go to the statically
+    // compiled function.
+    auto thunkVarType = llvm::PointerType::getUnqual(irs->context());
     auto thunkVar = new llvm::GlobalVariable(
         irs->module, thunkVarType, false, llvm::GlobalValue::PrivateLinkage,
-        llvm::ConstantPointerNull::get(thunkVarType),
-        ".rtcompile_thunkvar_" + srcFunc->getName());
+        srcFunc, ".rtcompile_thunkvar_" + srcFunc->getName());
     auto dstFunc = it->second.thunkFunc;
     createThunkFunc(irs->module, srcFunc, dstFunc, thunkVar);
     it->second.thunkVar = thunkVar;
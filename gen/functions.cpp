@@ -29,6 +29,7 @@
 #include "gen/abi/abi.h"
 #include "gen/arrays.h"
 #include "gen/classes.h"
+#include "gen/coverage.h"
 #include "gen/dcompute/target.h"
 #include "gen/dvalue.h"
 #include "gen/dynamiccompile.h"
@@ -869,6 +870,46 @@ void emitDMDStyleFunctionTrace(IRState &irs, FuncDeclaration *fd,
   }
 }
 
+void emitFunctionTrace(IRState &irs, FuncDeclaration *fd,
+                       FuncGenState &funcGen) {
+  /* -ftrace-functions: wrap the entire function body in:
+   *   _d_trace_enter(&traceInfo);
+   *   try
+   *     body;
+   *   finally
+   *     _d_trace_exit(&traceInfo);
+   * with a per-function `ldc.trace.FunctionTraceInfo traceInfo`, whose ID is
+   * assigned by the runtime on the first call. Function instances emitted
+   * into multiple object files share a single ID.
+   */
+  const auto mangle = mangleExact(fd);
+  const auto infoName = ("ldc.trace." + llvm::StringRef(mangle)).str();
+  auto info = irs.module.getGlobalVariable(infoName, true);
+  if (!info) {
+    auto init = llvm::ConstantStruct::getAnon(
+        {DtoConstUint(0), DtoConstString(mangle)});
+    info = new llvm::GlobalVariable(irs.module, init->getType(), false,
+                                    LLGlobalValue::LinkOnceODRLinkage, init,
+                                    infoName);
+    info->setVisibility(LLGlobalValue::HiddenVisibility);
+    const auto &triple = *global.params.targetTriple;
+    setLinkage({LLGlobalValue::LinkOnceODRLinkage,
+                needsCOMDAT() || triple.isOSBinFormatELF()},
+               info);
+  }
+
+  irs.ir->CreateCall(
+      getRuntimeFunction(fd->loc, irs.module, "_d_trace_enter"), {info});
+
+  // Push cleanup block that calls _d_trace_exit at function exit.
+  auto traceExitBB = irs.insertBB("trace_exit");
+  const auto savedInsertPoint = irs.saveInsertPoint();
+  irs.ir->SetInsertPoint(traceExitBB);
+  irs.ir->CreateCall(
+      getRuntimeFunction(fd->endloc, irs.module, "_d_trace_exit"), {info});
+  funcGen.scopes.pushCleanup(traceExitBB, irs.scopebb());
+}
+
 // If the specified block is trivially unreachable, erases it and returns true.
 // This is a common case because it happens when 'return' is the last statement
 // in a function.
@@ -1211,9 +1252,12 @@ void DtoDefineFunction(FuncDeclaration *fd, bool linkageAvailableExternally) {
 
   emitInstrumentationFnEnter(fd);
 
-  if (global.params.trace && fd->emitInstrumentation && !fd->isCMain() &&
-      !fd->isNaked()) {
-    emitDMDStyleFunctionTrace(*gIR, fd, funcGen);
+  if (fd->emitInstrumentation && !fd->isCMain() && !fd->isNaked()) {
+    if (opts::traceFunctions) {
+      emitFunctionTrace(*gIR, fd, funcGen);
+    } else if (global.params.trace) {
+      emitDMDStyleFunctionTrace(*gIR, fd, funcGen);
+    }
   }
 
   // disable frame-pointer-elimination for functions with DMD-style inline asm
@@ -1330,6 +1374,10 @@ void DtoDefineFunction(FuncDeclaration *fd, bool linkageAvailableExternally) {
     allocaPoint = nullptr;
   }
 
+  if (global.params.cov && opts::coverageEdges) {
+    emitCoverageEdgeCounters(*func);
+  }
+
   if (gIR->dcomputetarget && hasKernelAttr(fd)) {
     auto fn = gIR->module.getFunction(fd->mangleString);
     gIR->dcomputetarget->addKernelMetadata(fd, fn);
@@ -1657,9 +1657,7 @@ std::string llvmTypeToString(llvm::Type *type) {
   return result;
 }
 
-// Is the specified symbol defined in the druntime/Phobos libs?
-// For instantiated symbols: is the template declared in druntime/Phobos?
-static bool isDefaultLibSymbol(Dsymbol *sym) {
+bool isDefaultLibSymbol(Dsymbol *sym) {
   auto mod = sym->getModule();
   if (!mod)
     return false;
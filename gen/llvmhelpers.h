@@ -233,6 +233,10 @@ LLConstant *toConstantArray(LLType *ct, LLArrayType *at, T *str, size_t len,
 llvm::Constant *buildStringLiteralConstant(StringExp *se,
                                            uint64_t bufferLength);
 
+/// Returns true if the specified symbol is defined in the druntime/Phobos libs.
+/// For instantiated symbols: if the template is declared in druntime/Phobos.
+bool isDefaultLibSymbol(Dsymbol *sym);
+
 /// Returns true if the specified symbol is to be defined on declaration,
 /// primarily for -linkonce-templates.
 bool defineOnDeclare(Dsymbol *sym, bool isFunction);
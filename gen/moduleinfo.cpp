@@ -20,9 +20,12 @@
 #include "gen/mangling.h"
 #include "gen/rttibuilder.h"
 #include "gen/runtime.h"
+#include "ir/iraggr.h"
 #include "ir/irfunction.h"
 #include "ir/irmodule.h"
 #include "ir/irtype.h"
+#include <algorithm>
+#include <cstring>
 
 // These must match the values in druntime/src/object_.d
 #define MIstandalone 0x4
@@ -35,6 +38,7 @@
 #define MIunitTest 0x200
 #define MIimportedModules 0x400
 #define MIlocalClasses 0x800
+#define MIsortedLocalClasses 0x2000
 #define MInew 0x80000000 // it's the "new" layout
 
 using namespace dmd;
@@ -183,7 +187,8 @@ llvm::Constant *buildLocalClasses(Module *m, size_t &count) {
   ClassDeclarations aclasses;
   getLocalClasses(m, aclasses);
 
-  std::vector<LLConstant *> classInfoRefs;
+  // The classes with their ClassInfo names, computed once for sorting
+  std::vector<std::pair<const char *, IrClass *>> irClasses;
   for (auto cd : aclasses) {
     DtoResolveClass(cd);
 
@@ -201,7 +206,22 @@ llvm::Constant *buildLocalClasses(Module *m, size_t &count) {
     }
 
     IF_LOG Logger::println("class: %s", cd->toPrettyChars());
-    classInfoRefs.push_back(getIrAggr(cd)->getClassInfoSymbol());
+    IrClass *irc = getIrAggr(cd);
+    irClasses.emplace_back(irc->getClassInfoName(), irc);
+  }
+
+  // Sort by name, in the order of D string comparisons, so that druntime can
+  // binary-search the classes (TypeInfo_Class.find, Object.factory).
+  std::stable_sort(irClasses.begin(), irClasses.end(),
+                   [](const std::pair<const char *, IrClass *> &a,
+                      const std::pair<const char *, IrClass *> &b) {
+                     return strcmp(a.first, b.first) < 0;
+                   });
+
+  std::vector<LLConstant *> classInfoRefs;
+  classInfoRefs.reserve(irClasses.size());
+  for (const auto &entry : irClasses) {
+    classInfoRefs.push_back(entry.second->getClassInfoSymbol());
   }
   count = classInfoRefs.size();
 
@@ -275,7 +295,7 @@ llvm::GlobalVariable *genModuleInfo(Module *m) {
   size_t localClassesCount;
   const auto localClasses = buildLocalClasses(m, localClassesCount);
   if (localClasses) {
-    flags |= MIlocalClasses;
+    flags |= MIlocalClasses | MIsortedLocalClasses;
   }
 
   if (!m->needmoduleinfo) {
@@ -22,10 +22,12 @@
 #include "dmd/statement.h"
 #include "dmd/target.h"
 #include "dmd/template.h"
+#include "driver/cl_options.h"
 #include "driver/cl_options_instrumentation.h"
 #include "driver/timetrace.h"
 #include "gen/abi/abi.h"
 #include "gen/arrays.h"
+#include "gen/coverage.h"
 #include "gen/functions.h"
 #include "gen/irstate.h"
 #include "gen/llvm.h"
@@ -201,6 +203,76 @@ void emitModuleRefToSection(std::string moduleMangle,
   gIR->usedArray.push_back(thismref);
 }
 
+// Build the merge function for -cov-increment=sharded, which adds the
+// thread's counters to _d_cover_data:
+//   foreach (i; 0 .. numlines)
+//     if (auto count = tlsData[i]) {
+//       atomicOp!"+="(data[i], count);
+//       tlsData[i] = 0;
+//     }
+// It's registered with druntime (_d_cover_register_merge) instead of being a
+// module TLS dtor, so that covered modules don't take part in the cycle
+// detection of the ctor/dtor order.
+llvm::Function *buildCoverageMerge(Module *m, llvm::GlobalVariable *tlsData) {
+  OutBuffer mangleBuf;
+  mangleBuf.writestring("_D");
+  mangleToBuffer(m, mangleBuf);
+  mangleBuf.writestring("14_coverageMergeFZv");
+  const char *name = mangleBuf.peekChars();
+
+  IF_LOG Logger::println("Build coverage merging function: %s", name);
+
+  auto &context = gIR->context();
+  LLFunctionType *mergeTy =
+      LLFunctionType::get(LLType::getVoidTy(context), {}, false);
+  auto merge =
+      LLFunction::Create(mergeTy, LLGlobalValue::InternalLinkage,
+                         getIRMangledFuncName(name, LINK::d), &gIR->module);
+  merge->setCallingConv(gABI->callingConv(LINK::c));
+  if (global.params.targetTriple->getArch() == llvm::Triple::x86_64) {
+    merge->setUWTableKind(llvm::UWTableKind::Default);
+  }
+
+  auto entryBB = llvm::BasicBlock::Create(context, "", merge);
+  auto loopBB = llvm::BasicBlock::Create(context, "loop", merge);
+  auto addBB = llvm::BasicBlock::Create(context, "add", merge);
+  auto nextBB = llvm::BasicBlock::Create(context, "next", merge);
+  auto endBB = llvm::BasicBlock::Create(context, "end", merge);
+  IRBuilder<> builder(entryBB);
+  builder.CreateBr(loopBB);
+
+  auto type = tlsData->getValueType();
+  builder.SetInsertPoint(loopBB);
+  auto index = builder.CreatePHI(DtoSize_t(), 2, "i");
+  index->addIncoming(DtoConstSize_t(0), entryBB);
+  auto tlsCounter = builder.CreateInBoundsGEP(type, tlsData,
+                                              {DtoConstSize_t(0), index});
+  auto count =
+      builder.CreateAlignedLoad(builder.getInt32Ty(), tlsCounter,
+                                llvm::Align(4), "count");
+  builder.CreateCondBr(builder.CreateIsNotNull(count), addBB, nextBB);
+
+  builder.SetInsertPoint(addBB);
+  auto counter = builder.CreateInBoundsGEP(type, m->d_cover_data,
+                                           {DtoConstSize_t(0), index});
+  builder.CreateAtomicRMW(llvm::AtomicRMWInst::Add, counter, count,
+                          llvm::Align(4), llvm::AtomicOrdering::Monotonic);
+  builder.CreateAlignedStore(DtoConstUint(0), tlsCounter, llvm::Align(4));
+  builder.CreateBr(nextBB);
+
+  builder.SetInsertPoint(nextBB);
+  auto nextIndex = builder.CreateAdd(index, DtoConstSize_t(1));
+  index->addIncoming(nextIndex, nextBB);
+  builder.CreateCondBr(
+      builder.CreateICmpEQ(nextIndex, DtoConstSize_t(m->numlines)), endBB,
+      loopBB);
+
+  builder.SetInsertPoint(endBB);
+  builder.CreateRetVoid();
+
+  return merge;
+}
+
 // Add module-private variables and functions for coverage analysis.
 void addCoverageAnalysis(Module *m) {
   IF_LOG {
@@ -267,6 +339,30 @@ void addCoverageAnalysis(Module *m) {
         DtoConstSlice(DtoConstSize_t(m->numlines), m->d_cover_data);
   }
 
+  // uint[# source lines] _d_cover_data_tls, for -cov-increment=sharded.
+  // The counters are incremented without contention and added to
+  // _d_cover_data when the thread exits, and for the main thread right before
+  // the coverage report is written.
+  if (opts::coverageIncrement == opts::CoverageIncrement::sharded &&
+      !opts::coverageEdges && m->numlines > 0) {
+    IF_LOG Logger::println(
+        "Build private thread-local variable: uint[%d] _d_cover_data_tls",
+        m->numlines);
+
+    LLArrayType *type =
+        LLArrayType::get(LLType::getInt32Ty(gIR->context()), m->numlines);
+    IrModule *irm = getIrModule(m);
+    irm->coverageTlsData = defineGlobal(
+        Loc(), gIR->module, "_d_cover_data_tls",
+        llvm::ConstantAggregateZero::get(type), LLGlobalValue::InternalLinkage,
+        /*isConstant=*/false, /*isThreadLocal=*/true);
+    irm->coverageMerge = buildCoverageMerge(m, irm->coverageTlsData);
+  }
+
+  // -cov-edges: counters on control flow edges, from which a merge function
+  // computes the line counts
+  addCoverageEdges(m);
+
   // Create "static constructor" that calls _d_cover_register2(string filename,
   // size_t[] valid, uint[] data, ubyte minPercent)
   // Build ctor name
@@ -308,6 +404,19 @@ void addCoverageAnalysis(Module *m) {
 
     builder.CreateCall(fn, args);
 
+    // Register the function merging the pending counts, run at each thread
+    // exit for thread-local counters:
+    // _d_cover_register_merge(&merge, perThread)
+    if (auto merge = getIrModule(m)->coverageMerge) {
+      llvm::Function *registerFn =
+          getRuntimeFunction(Loc(), gIR->module, "_d_cover_register_merge");
+      const bool perThread =
+          opts::coverageIncrement == opts::CoverageIncrement::sharded;
+      auto call =
+          builder.CreateCall(registerFn, {merge, DtoConstBool(perThread)});
+      call->setAttributes(registerFn->getAttributes());
+    }
+
     builder.CreateRetVoid();
   }
 
@@ -333,6 +442,8 @@ void addCoverageAnalysisInitializer(Module *m) {
     arrayInits[i] = DtoConstSize_t(m->d_cover_valid_init[i]);
   }
   m->d_cover_valid->setInitializer(llvm::ConstantArray::get(type, arrayInits));
+
+  finalizeCoverageEdges(m);
 }
 
 // Load InstrProf data from file and store in it IrState
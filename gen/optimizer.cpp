@@ -11,8 +11,10 @@
 
 #include "dmd/errors.h"
 #include "gen/logger.h"
+#include "gen/passes/BoundsCheckElimination.h"
 #include "gen/passes/GarbageCollect2Stack.h"
 #include "gen/passes/StripExternals.h"
+#include "gen/passes/StripUnusedTypeInfo.h"
 #include "gen/passes/SimplifyDRuntimeCalls.h"
 #include "gen/passes/Passes.h"
 #include "driver/cl_options.h"
@@ -51,6 +53,7 @@
 #include "llvm/Transforms/Instrumentation/PGOInstrumentation.h"
 #include "llvm/Transforms/IPO/GlobalDCE.h"
 #include "llvm/Transforms/Scalar/EarlyCSE.h"
+#include "llvm/Transforms/Scalar/InductiveRangeCheckElimination.h"
 #include "llvm/Transforms/Scalar/LICM.h"
 #include "llvm/Transforms/Scalar/Reassociate.h"
 #include "llvm/Transforms/Instrumentation/SanitizerCoverage.h"
@@ -96,6 +99,14 @@ static cl::opt<bool> disableGCToStack(
     "disable-gc2stack", cl::ZeroOrMore,
     cl::desc("Disable promotion of GC allocations to stack memory"));
 
+static cl::opt<bool> disableBoundsCheckElimination(
+    "disable-boundscheck-elim", cl::ZeroOrMore,
+    cl::desc("Disable removal of array bounds checks proven to pass"));
+
+static cl::opt<bool> disableTypeInfoSweep(
+    "disable-typeinfo-sweep", cl::ZeroOrMore,
+    cl::desc("Disable removal of TypeInfos unreferenced after optimization"));
+
 static cl::opt<cl::boolOrDefault, false, opts::FlagParser<cl::boolOrDefault>>
     enableInlining(
         "inlining", cl::ZeroOrMore,
@@ -276,6 +287,15 @@ static void addStripExternalsPass(ModulePassManager &mpm,
   }
 }
 
+static void addStripUnusedTypeInfoPass(ModulePassManager &mpm,
+                                       OptimizationLevel level) {
+  // also at -O0, after the D passes looking at the TypeInfo metadata
+  mpm.addPass(StripUnusedTypeInfoPass());
+  if (verifyEach) {
+    mpm.addPass(VerifierPass());
+  }
+}
+
 static void addSimplifyDRuntimeCallsPass(ModulePassManager &mpm,
                                       OptimizationLevel level ) {
   if (level == OptimizationLevel::O2  || level == OptimizationLevel::O3) {
@@ -296,6 +316,18 @@ static void addGarbageCollect2StackPass(ModulePassManager &mpm,
   }
 }
 
+static void addBoundsCheckEliminationPass(FunctionPassManager &fpm,
+                                          OptimizationLevel level) {
+  if (level == OptimizationLevel::O2 || level == OptimizationLevel::O3) {
+    fpm.addPass(BoundsCheckEliminationPass());
+    // Split the iteration space of loops with the remaining induction variable
+    // checks, so that they can be omitted in the main loop.
+    fpm.addPass(IRCEPass());
+    if (verifyEach) {
+      fpm.addPass(VerifierPass());
+    }
+  }
+}
 
 static llvm::Optional<PGOOptions> getPGOOptions() {
   // FIXME: Do we have these anywhere?
@@ -470,10 +502,17 @@ void runOptimizationPasses(llvm::Module *M) {
       //(had registerLoopOptimizerEndEPCallback) but that seems wrong
       pb.registerOptimizerLastEPCallback(addGarbageCollect2StackPass);
     }
+    if (!disableBoundsCheckElimination) {
+      pb.registerScalarOptimizerLateEPCallback(addBoundsCheckEliminationPass);
+    }
   }
 
   pb.registerOptimizerLastEPCallback(addStripExternalsPass);
 
+  if (!disableLangSpecificPasses && !disableTypeInfoSweep) {
+    pb.registerOptimizerLastEPCallback(addStripUnusedTypeInfoPass);
+  }
+
   registerAllPluginsWithPassBuilder(pb);
 
   pb.registerModuleAnalyses(mam);
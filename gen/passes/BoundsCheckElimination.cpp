@@ -0,0 +1,132 @@
+//===-- BoundsCheckElimination.cpp - Remove array bounds checks -----------===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This transform removes array index and slice bounds checks which can be
+// proven to always pass. The checks are recognized by the BOUNDS_CHECK_MD
+// attachment of their branch, whose condition compares the index (or slice
+// bounds) against the length with an unsigned predicate. Each comparison is
+// handed to scalar evolution, which takes the induction variables of the
+// enclosing loops and the conditions guarding the check into account, so
+// e.g. `a[i]` in a loop over `i < a.length` doesn't need a check anymore.
+//
+// Most checks of an induction variable against a loop-invariant length are
+// already removed by IndVarSimplify. This pass runs late, after LICM and GVN,
+// so it also handles the lengths reloaded from memory in the loop (slices
+// behind `ref` parameters or in fields), which only become the loop bound once
+// GVN has merged the hoisted loads. A length which may be modified in the loop,
+// e.g. by stores to the slice elements (which LLVM can't tell apart from the
+// slice itself), is compared as reloaded and can't be proven.
+//
+// The checks of induction variables which can't be proven for all iterations
+// are left to LLVM's inductive range check elimination, which runs right
+// after this pass and splits the loop's iteration space instead.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "boundscheck-elim"
+
+#include "gen/passes/BoundsCheckElimination.h"
+#include "metadata.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/PatternMatch.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+STATISTIC(NumChecks, "Number of array bounds checks analyzed");
+STATISTIC(NumEliminated, "Number of array bounds checks removed");
+STATISTIC(NumComparisons, "Number of bounds comparisons removed");
+
+namespace {
+/// Collects the uses of the individual comparisons making up the (possibly
+/// conjunctive) condition of a bounds check branch.
+void collectComparisons(Use &cond, SmallVectorImpl<Use *> &comparisons) {
+  auto *I = dyn_cast<Instruction>(cond.get());
+  if (I && I->hasOneUse() &&
+      PatternMatch::match(I, PatternMatch::m_LogicalAnd(
+                                 PatternMatch::m_Value(),
+                                 PatternMatch::m_Value()))) {
+    // `and i1 a, b` or `select i1 a, i1 b, i1 false`
+    collectComparisons(I->getOperandUse(0), comparisons);
+    collectComparisons(I->getOperandUse(1), comparisons);
+    return;
+  }
+  if (isa<ICmpInst>(cond.get())) {
+    comparisons.push_back(&cond);
+  }
+}
+
+/// Returns whether the comparison is known to hold whenever `check` executes.
+bool isKnownAt(ICmpInst *cmp, BranchInst *check, ScalarEvolution &SE) {
+  if (!cmp->isUnsigned() || !SE.isSCEVable(cmp->getOperand(0)->getType())) {
+    return false;
+  }
+  const SCEV *lhs = SE.getSCEV(cmp->getOperand(0));
+  const SCEV *rhs = SE.getSCEV(cmp->getOperand(1));
+  return SE.isKnownPredicateAt(cmp->getPredicate(), lhs, rhs, check);
+}
+} // anonymous namespace
+
+bool BoundsCheckElimination::run(Function &F, LoopInfo &LI,
+                                 ScalarEvolution &SE) {
+  const unsigned kindID = F.getContext().getMDKindID(BOUNDS_CHECK_MD);
+
+  SmallVector<BranchInst *, 16> checks;
+  for (BasicBlock &BB : F) {
+    auto *BI = dyn_cast<BranchInst>(BB.getTerminator());
+    if (BI && BI->isConditional() && BI->getMetadata(kindID)) {
+      checks.push_back(BI);
+    }
+  }
+
+  bool changed = false;
+  Constant *const trueVal = ConstantInt::getTrue(F.getContext());
+  for (BranchInst *BI : checks) {
+    ++NumChecks;
+
+    SmallVector<Use *, 2> comparisons;
+    collectComparisons(BI->getOperandUse(0), comparisons);
+
+    unsigned numKnown = 0;
+    for (Use *U : comparisons) {
+      if (!isKnownAt(cast<ICmpInst>(U->get()), BI, SE)) {
+        continue;
+      }
+      LLVM_DEBUG(dbgs() << "Removing bounds comparison " << *U->get()
+                        << " in " << F.getName() << '\n');
+      U->set(trueVal);
+      ++numKnown;
+      ++NumComparisons;
+    }
+
+    if (numKnown == 0) {
+      continue;
+    }
+    if (numKnown == comparisons.size()) {
+      ++NumEliminated;
+    }
+    // The failure edge may have been an exit of the loop, so its trip count
+    // has to be recomputed.
+    if (Loop *L = LI.getLoopFor(BI->getParent())) {
+      while (Loop *parent = L->getParentLoop()) {
+        L = parent;
+      }
+      SE.forgetLoop(L);
+    }
+    changed = true;
+  }
+
+  // The now unreachable failure blocks and dead comparisons are cleaned up by
+  // the following SimplifyCFG and InstCombine runs.
+  return changed;
+}
@@ -0,0 +1,49 @@
+//===-- gen/passes/BoundsCheckElimination.h - Remove array bounds checks --===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/PassManager.h"
+
+/// This pass removes the array bounds checks emitted by LDC (tagged with
+/// BOUNDS_CHECK_MD) which scalar evolution proves to always pass, e.g. for
+/// indices bounded by the loop condition.
+struct LLVM_LIBRARY_VISIBILITY BoundsCheckElimination {
+  bool run(llvm::Function &F, llvm::LoopInfo &LI, llvm::ScalarEvolution &SE);
+
+  static llvm::StringRef getPassName() { return "BoundsCheckElimination"; }
+};
+
+struct LLVM_LIBRARY_VISIBILITY BoundsCheckEliminationPass
+    : public llvm::PassInfoMixin<BoundsCheckEliminationPass> {
+
+  llvm::PreservedAnalyses run(llvm::Function &F,
+                              llvm::FunctionAnalysisManager &fam) {
+    auto &LI = fam.getResult<llvm::LoopAnalysis>(F);
+    auto &SE = fam.getResult<llvm::ScalarEvolutionAnalysis>(F);
+
+    if (pass.run(F, LI, SE)) {
+      // Only branch conditions are replaced.
+      llvm::PreservedAnalyses pa;
+      pa.preserveSet<llvm::CFGAnalyses>();
+      return pa;
+    }
+    return llvm::PreservedAnalyses::all();
+  }
+
+  static llvm::StringRef name() {
+    return BoundsCheckElimination::getPassName();
+  }
+
+private:
+  BoundsCheckElimination pass;
+};
@@ -22,8 +22,6 @@
 #include "llvm/ADT/SmallSet.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/Statistic.h"
-#include "llvm/ADT/StringMap.h"
-#include "llvm/ADT/StringSwitch.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/DataLayout.h"
 #include "llvm/IR/Dominators.h"
@@ -371,6 +369,7 @@ bool GarbageCollect2Stack::run(Function &F, std::function<DominatorTree& ()> get
   const DataLayout &DL = F.getParent()->getDataLayout();
   CallGraphNode *CGNode = CG ? (*CG)[&F] : nullptr;
   G2StackAnalysis A = {DL, *F.getParent(), CG, CGNode};
+  const unsigned HookKindID = F.getContext().getMDKindID(RT_HOOK_MD);
 
   BasicBlock &Entry = F.getEntryBlock();
 
@@ -396,14 +395,26 @@ bool GarbageCollect2Stack::run(Function &F, std::function<DominatorTree& ()> get
       }
 
 
-      //FunctionInfo *info = OMI->getValue();
-      FunctionInfo *info = StringSwitch<FunctionInfo*>(Callee->getName())
-     .Case("_d_allocmemoryT", &AllocMemoryT)
-     .Case("_d_newarrayU",    &NewArrayU)
-     .Case("_d_newarrayT",    &NewArrayT)
-     .Case("_d_allocclass",   &AllocClass)
-     .Case("_d_allocmemory",  &AllocMemory)
-     .Default(nullptr);
+      FunctionInfo *info = nullptr;
+      switch (getRuntimeHookID(Callee, HookKindID)) {
+      case RH_AllocMemoryT:
+        info = &AllocMemoryT;
+        break;
+      case RH_NewArrayU:
+        info = &NewArrayU;
+        break;
+      case RH_NewArrayT:
+        info = &NewArrayT;
+        break;
+      case RH_AllocClass:
+        info = &AllocClass;
+        break;
+      case RH_AllocMemory:
+        info = &AllocMemory;
+        break;
+      default:
+        break;
+      }
 
       // Ignore unknown calls.
       if (!info) {
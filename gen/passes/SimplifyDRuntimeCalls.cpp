@@ -20,8 +20,8 @@
 #include "gen/passes/SimplifyDRuntimeCalls.h"
 #include "gen/tollvm.h"
 #include "gen/runtime.h"
+#include "metadata.h"
 #include "llvm/ADT/Statistic.h"
-#include "llvm/ADT/StringMap.h"
 #include "llvm/IR/DataLayout.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Intrinsics.h"
@@ -265,9 +265,9 @@ FunctionPass *createSimplifyDRuntimeCalls() {
 /// we know.
 void SimplifyDRuntimeCalls::InitOptimizations() {
   // Some array-related optimizations
-  Optimizations["_d_arraysetlengthT"] = &ArraySetLength;
-  Optimizations["_d_arraysetlengthiT"] = &ArraySetLength;
-  Optimizations["_d_array_slice_copy"] = &ArraySliceCopy;
+  Optimizations[RH_ArraySetLengthT] = &ArraySetLength;
+  Optimizations[RH_ArraySetLengthiT] = &ArraySetLength;
+  Optimizations[RH_ArraySliceCopy] = &ArraySliceCopy;
 
   /* Delete calls to runtime functions which aren't needed if their result is
    * unused. That comes down to functions that don't do anything but
@@ -278,21 +278,23 @@ void SimplifyDRuntimeCalls::InitOptimizations() {
    * (We can't mark allocating calls as readonly/readnone because they don't
    * return the same pointer every time when called with the same arguments)
    */
-  Optimizations["_d_allocmemoryT"] = &Allocation;
-  Optimizations["_d_newarrayT"] = &Allocation;
-  Optimizations["_d_newarrayiT"] = &Allocation;
-  Optimizations["_d_newarrayU"] = &Allocation;
-  Optimizations["_d_newarraymT"] = &Allocation;
-  Optimizations["_d_newarraymiT"] = &Allocation;
-  Optimizations["_d_newarraymvT"] = &Allocation;
-  Optimizations["_d_newclass"] = &Allocation;
-  Optimizations["_d_allocclass"] = &Allocation;
+  Optimizations[RH_AllocMemoryT] = &Allocation;
+  Optimizations[RH_NewArrayT] = &Allocation;
+  Optimizations[RH_NewArrayiT] = &Allocation;
+  Optimizations[RH_NewArrayU] = &Allocation;
+  Optimizations[RH_NewArraymT] = &Allocation;
+  Optimizations[RH_NewArraymiT] = &Allocation;
+  Optimizations[RH_NewArraymvT] = &Allocation;
+  Optimizations[RH_NewClass] = &Allocation;
+  Optimizations[RH_AllocClass] = &Allocation;
+
+  Initialized = true;
 }
 
 /// runOnFunction - Top level algorithm.
 ///
 bool SimplifyDRuntimeCalls::run(Function &F,  std::function<AAResults& ()> getAA) {
-  if (Optimizations.empty()) {
+  if (!Initialized) {
     InitOptimizations();
   }
 
@@ -317,6 +319,7 @@ bool SimplifyDRuntimeCalls::run(Function &F,  std::function<AAResults& ()> getAA
 bool SimplifyDRuntimeCalls::runOnce(Function &F, const DataLayout *DL,
                                     AAResults &AA) {
   IRBuilder<> Builder(F.getContext());
+  const unsigned HookKindID = F.getContext().getMDKindID(RT_HOOK_MD);
 
   bool Changed = false;
   for (auto &BB : F) {
@@ -335,8 +338,9 @@ bool SimplifyDRuntimeCalls::runOnce(Function &F, const DataLayout *DL,
       }
 
       // Ignore unknown calls.
-      auto OMI = Optimizations.find(Callee->getName());
-      if (OMI == Optimizations.end()) {
+      LibCallOptimization *Opt =
+          Optimizations[getRuntimeHookID(Callee, HookKindID)];
+      if (!Opt) {
         continue;
       }
 
@@ -349,7 +353,7 @@ bool SimplifyDRuntimeCalls::runOnce(Function &F, const DataLayout *DL,
       Builder.SetInsertPoint(&BB, I);
 
       // Try to optimize this call.
-      Value *Result = OMI->second->OptimizeCall(CI, Changed, DL, AA, Builder);
+      Value *Result = Opt->OptimizeCall(CI, Changed, DL, AA, Builder);
       if (Result == nullptr) {
         continue;
       }
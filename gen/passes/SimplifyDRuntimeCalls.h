@@ -1,7 +1,7 @@
 #pragma once
 #include "gen/llvm.h"
 #include "gen/passes/Passes.h"
-#include "llvm/ADT/StringMap.h"
+#include "metadata.h"
 #include "llvm/Analysis/AliasAnalysis.h"
 
 //===----------------------------------------------------------------------===//
@@ -59,7 +59,9 @@ struct LLVM_LIBRARY_VISIBILITY ArraySliceCopyOpt : public LibCallOptimization {
 /// This pass optimizes library functions from the D runtime as used by LDC.
 ///
 struct LLVM_LIBRARY_VISIBILITY SimplifyDRuntimeCalls {
-  llvm::StringMap<LibCallOptimization *> Optimizations;
+  /// Indexed by RuntimeHookID; null for hooks without optimizations.
+  LibCallOptimization *Optimizations[RH_NumHooks] = {};
+  bool Initialized = false;
 
   // Array operations
   ArraySetLengthOpt ArraySetLength;
@@ -0,0 +1,151 @@
+//===-- StripUnusedTypeInfo.cpp - Remove unreferenced TypeInfos -----------===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// TypeInfos are emitted as linkonce_odr into each module referencing them.
+// Many of these references disappear during optimization (inlined druntime
+// calls, GC allocations promoted to the stack, dead code), and so do whole
+// TypeInfo graphs, e.g. the TypeInfo_Array of a struct, the TypeInfo_Struct
+// and its m_arg1/m_arg2 TypeInfos, and discardable functions only referenced
+// by a TypeInfo_Struct.
+//
+// This transform removes them regardless of the optimization level, i.e. also
+// for -O0 and the LTO pre-link pipelines, and drops the TypeInfo metadata
+// (see TD_PREFIX) of all TypeInfos no longer present in the module, which
+// would otherwise be kept in the (LTO) bitcode.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "strip-unused-typeinfo"
+
+#include "gen/passes/StripUnusedTypeInfo.h"
+#include "metadata.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+STATISTIC(NumTypeInfos, "Number of unreferenced TypeInfos removed");
+STATISTIC(NumFunctions, "Number of functions only used by TypeInfos removed");
+STATISTIC(NumMetadata, "Number of TypeInfo metadata nodes removed");
+
+namespace {
+/// Collects the globals referenced by a TypeInfo initializer.
+void collectReferencedGlobals(Constant *c,
+                              SmallPtrSetImpl<GlobalValue *> &globals,
+                              SmallPtrSetImpl<Constant *> &visited) {
+  if (!visited.insert(c).second) {
+    return;
+  }
+  if (auto gv = dyn_cast<GlobalValue>(c)) {
+    globals.insert(gv);
+    return;
+  }
+  for (Use &op : c->operands()) {
+    collectReferencedGlobals(cast<Constant>(op.get()), globals, visited);
+  }
+}
+
+bool isUnused(GlobalValue *gv) {
+  if (!gv->isDiscardableIfUnused()) {
+    return false;
+  }
+  gv->removeDeadConstantUsers();
+  return gv->use_empty();
+}
+} // anonymous namespace
+
+bool StripUnusedTypeInfo::run(Module &M) {
+  const StringRef prefix = TD_PREFIX;
+
+  // Map the TypeInfo globals to their metadata.
+  DenseMap<GlobalVariable *, NamedMDNode *> typeInfos;
+  SmallVector<NamedMDNode *, 16> orphanedMetadata;
+  for (NamedMDNode &node : M.named_metadata()) {
+    StringRef name = node.getName();
+    if (!name.consume_front(prefix)) {
+      continue;
+    }
+    GlobalVariable *gv = M.getGlobalVariable(name, /*AllowInternal=*/true);
+    if (!gv) {
+      gv = M.getGlobalVariable(("\1" + name).str(), /*AllowInternal=*/true);
+    }
+    if (gv) {
+      typeInfos[gv] = &node;
+    } else {
+      orphanedMetadata.push_back(&node);
+    }
+  }
+
+  SmallVector<GlobalVariable *, 16> worklist;
+  for (auto &entry : typeInfos) {
+    worklist.push_back(entry.first);
+  }
+
+  // The functions referenced by removed TypeInfos.
+  SmallSetVector<Function *, 16> functions;
+
+  bool changed = false;
+  while (!worklist.empty()) {
+    GlobalVariable *gv = worklist.pop_back_val();
+    // may have been queued multiple times
+    if (!typeInfos.count(gv) || !gv->hasInitializer() || !isUnused(gv)) {
+      continue;
+    }
+
+    SmallPtrSet<GlobalValue *, 8> referenced;
+    SmallPtrSet<Constant *, 32> visited;
+    collectReferencedGlobals(gv->getInitializer(), referenced, visited);
+
+    LLVM_DEBUG(dbgs() << "Removing unused TypeInfo " << gv->getName() << '\n');
+    auto it = typeInfos.find(gv);
+    orphanedMetadata.push_back(it->second);
+    typeInfos.erase(it);
+    gv->eraseFromParent();
+    ++NumTypeInfos;
+    changed = true;
+
+    // Referenced TypeInfos may have become unused now, as well as functions
+    // like xtoHash which are emitted into each referencing module.
+    for (GlobalValue *ref : referenced) {
+      if (auto refVar = dyn_cast<GlobalVariable>(ref)) {
+        if (typeInfos.count(refVar)) {
+          worklist.push_back(refVar);
+        }
+      } else if (auto fn = dyn_cast<Function>(ref)) {
+        if (!fn->isDeclaration()) {
+          functions.insert(fn);
+        }
+      }
+    }
+  }
+
+  for (Function *fn : functions) {
+    if (isUnused(fn)) {
+      LLVM_DEBUG(dbgs() << "Removing function only used by TypeInfos "
+                        << fn->getName() << '\n');
+      fn->eraseFromParent();
+      ++NumFunctions;
+    }
+  }
+
+  for (NamedMDNode *node : orphanedMetadata) {
+    M.eraseNamedMetadata(node);
+    ++NumMetadata;
+    changed = true;
+  }
+
+  return changed;
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include "gen/llvm.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+
+/// This pass removes the TypeInfo definitions left unreferenced by the
+/// optimizer, together with their metadata and the discardable functions
+/// (e.g. TypeInfo_Struct xtoHash/xopEquals of templated structs) only used by
+/// them.
+struct LLVM_LIBRARY_VISIBILITY StripUnusedTypeInfo {
+  bool run(llvm::Module &M);
+};
+
+struct LLVM_LIBRARY_VISIBILITY StripUnusedTypeInfoPass
+    : public llvm::PassInfoMixin<StripUnusedTypeInfoPass> {
+
+  llvm::PreservedAnalyses run(llvm::Module &M,
+                              llvm::ModuleAnalysisManager &mam) {
+    if (pass.run(M)) {
+      return llvm::PreservedAnalyses::none();
+    }
+    return llvm::PreservedAnalyses::all();
+  }
+
+  static llvm::StringRef name() { return "StripUnusedTypeInfo"; }
+
+private:
+  StripUnusedTypeInfo pass;
+};
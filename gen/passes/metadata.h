@@ -13,6 +13,9 @@
 
 #pragma once
 
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
 #include "llvm/IR/Metadata.h"
 
 // *** Metadata for TypeInfo instances ***
@@ -41,3 +44,87 @@ inline std::string getMetadataName(const char *prefix,
   return (prefix + (globalName[0] == '\1' ? globalName.substr(1) : globalName))
       .str();
 }
+
+// *** Metadata for D runtime hooks ***
+// Declarations of the druntime functions the LDC passes know about carry an
+// attachment of this kind (added by getRuntimeFunction()). Its single operand
+// is an i32 RuntimeHookID, so that the passes can dispatch on the callee
+// without comparing function names.
+#define RT_HOOK_MD "ldc.rthook"
+
+/// The druntime functions recognized by the LDC-specific optimization passes.
+enum RuntimeHookID : unsigned {
+  RH_None, /// Not a known runtime hook.
+
+  RH_AllocMemory,       /// _d_allocmemory
+  RH_AllocMemoryT,      /// _d_allocmemoryT
+  RH_NewArrayT,         /// _d_newarrayT
+  RH_NewArrayiT,        /// _d_newarrayiT
+  RH_NewArrayU,         /// _d_newarrayU
+  RH_NewArraymT,        /// _d_newarraymT
+  RH_NewArraymiT,       /// _d_newarraymiT
+  RH_NewArraymvT,       /// _d_newarraymvT
+  RH_NewClass,          /// _d_newclass
+  RH_AllocClass,        /// _d_allocclass
+  RH_ArraySetLengthT,   /// _d_arraysetlengthT
+  RH_ArraySetLengthiT,  /// _d_arraysetlengthiT
+  RH_ArraySliceCopy,    /// _d_array_slice_copy
+
+  // Must be kept last
+  RH_NumHooks /// The number of runtime hook IDs
+};
+
+/// Maps a runtime function name to its hook ID (RH_None if unknown).
+/// Only used when declaring the functions, never when running the passes.
+inline RuntimeHookID getRuntimeHookID(llvm::StringRef name) {
+  return llvm::StringSwitch<RuntimeHookID>(name)
+      .Case("_d_allocmemory", RH_AllocMemory)
+      .Case("_d_allocmemoryT", RH_AllocMemoryT)
+      .Case("_d_newarrayT", RH_NewArrayT)
+      .Case("_d_newarrayiT", RH_NewArrayiT)
+      .Case("_d_newarrayU", RH_NewArrayU)
+      .Case("_d_newarraymT", RH_NewArraymT)
+      .Case("_d_newarraymiT", RH_NewArraymiT)
+      .Case("_d_newarraymvT", RH_NewArraymvT)
+      .Case("_d_newclass", RH_NewClass)
+      .Case("_d_allocclass", RH_AllocClass)
+      .Case("_d_arraysetlengthT", RH_ArraySetLengthT)
+      .Case("_d_arraysetlengthiT", RH_ArraySetLengthiT)
+      .Case("_d_array_slice_copy", RH_ArraySliceCopy)
+      .Default(RH_None);
+}
+
+/// Attaches the runtime hook metadata to a function declaration.
+inline void setRuntimeHookID(llvm::Function *fn, RuntimeHookID id) {
+  assert(id != RH_None && id < RH_NumHooks);
+  llvm::LLVMContext &ctx = fn->getContext();
+  auto *idConst = llvm::ConstantInt::get(llvm::Type::getInt32Ty(ctx), id);
+  fn->setMetadata(RT_HOOK_MD,
+                  llvm::MDNode::get(ctx, llvm::ConstantAsMetadata::get(idConst)));
+}
+
+/// Returns the runtime hook ID of a callee (RH_None if it isn't tagged).
+/// `kindID` is the metadata kind ID of RT_HOOK_MD in the callee's context.
+inline RuntimeHookID getRuntimeHookID(const llvm::Function *fn,
+                                      unsigned kindID) {
+  if (!fn->hasMetadata()) {
+    return RH_None;
+  }
+  llvm::MDNode *node = fn->getMetadata(kindID);
+  if (!node || node->getNumOperands() != 1) {
+    return RH_None;
+  }
+  auto *id = llvm::mdconst::dyn_extract<llvm::ConstantInt>(node->getOperand(0));
+  if (!id || id->getZExtValue() >= RH_NumHooks) {
+    return RH_None;
+  }
+  return static_cast<RuntimeHookID>(id->getZExtValue());
+}
+
+// *** Metadata for array bounds checks ***
+// The conditional branches of array index and slice bounds checks carry an
+// (empty) attachment of this kind. Their condition is an unsigned comparison
+// of the index against the length, or a conjunction of such comparisons, and
+// their false successor reports the RangeError, so that the bounds check
+// elimination pass can tell them apart from user-written comparisons.
+#define BOUNDS_CHECK_MD "ldc.boundscheck"
@@ -164,9 +164,9 @@ struct MapRegionCounters : public StoppableVisitor {
   /// The function hash.
   PGOHash Hash;
   /// The map of statements to counters.
-  llvm::DenseMap<const RootObject *, unsigned> &CounterMap;
+  CodeGenPGO::RegionMap &CounterMap;
 
-  MapRegionCounters(llvm::DenseMap<const RootObject *, unsigned> &CounterMap)
+  MapRegionCounters(CodeGenPGO::RegionMap &CounterMap)
       : NextCounter(0), CounterMap(CounterMap) {}
 
   using StoppableVisitor::visit;
@@ -223,43 +223,43 @@ struct MapRegionCounters : public StoppableVisitor {
       // Stop recursion at this depth.
       stop = true;
     } else {
-      CounterMap[fd->fbody] = NextCounter++;
+      CounterMap[fd->fbody].Counter = NextCounter++;
     }
   }
 
   void visit(IfStatement *stmt) override {
     SKIP_VISITED(stmt);
-    CounterMap[stmt] = NextCounter++;
+    CounterMap[stmt].Counter = NextCounter++;
     Hash.combine(PGOHash::IfStmt);
   }
 
   void visit(WhileStatement *stmt) override {
     SKIP_VISITED(stmt);
-    CounterMap[stmt] = NextCounter++;
+    CounterMap[stmt].Counter = NextCounter++;
     Hash.combine(PGOHash::WhileStmt);
   }
 
   void visit(DoStatement *stmt) override {
     SKIP_VISITED(stmt);
-    CounterMap[stmt] = NextCounter++;
+    CounterMap[stmt].Counter = NextCounter++;
     Hash.combine(PGOHash::DoStmt);
   }
 
   void visit(ForStatement *stmt) override {
     SKIP_VISITED(stmt);
-    CounterMap[stmt] = NextCounter++;
+    CounterMap[stmt].Counter = NextCounter++;
     Hash.combine(PGOHash::ForStmt);
   }
 
   void visit(ForeachStatement *stmt) override {
     SKIP_VISITED(stmt);
-    CounterMap[stmt] = NextCounter++;
+    CounterMap[stmt].Counter = NextCounter++;
     Hash.combine(PGOHash::ForeachStmt);
   }
 
   void visit(ForeachRangeStatement *stmt) override {
     SKIP_VISITED(stmt);
-    CounterMap[stmt] = NextCounter++;
+    CounterMap[stmt].Counter = NextCounter++;
     Hash.combine(PGOHash::ForeachRangeStmt);
   }
 
@@ -272,34 +272,34 @@ struct MapRegionCounters : public StoppableVisitor {
     // The counter for the UnrolledLoopStatement itself counts the
     // exit block of the 'loop'.
     SKIP_VISITED(stmt);
-    CounterMap[stmt] = NextCounter++;
+    CounterMap[stmt].Counter = NextCounter++;
     Hash.combine(PGOHash::UnrolledLoopIterationScope);
     for (auto s : *stmt->statements) {
-      CounterMap[s] = NextCounter++;
+      CounterMap[s].Counter = NextCounter++;
       Hash.combine(PGOHash::UnrolledLoopIterationScope);
     }
   }
 
   void visit(LabelStatement *stmt) override {
     SKIP_VISITED(stmt);
-    CounterMap[stmt] = NextCounter++;
+    CounterMap[stmt].Counter = NextCounter++;
     Hash.combine(PGOHash::LabelStmt);
   }
 
   void visit(SwitchStatement *stmt) override {
     SKIP_VISITED(stmt);
-    CounterMap[stmt] = NextCounter++;
+    CounterMap[stmt].Counter = NextCounter++;
     Hash.combine(PGOHash::SwitchStmt);
   }
 
   void visit(CaseStatement *stmt) override {
     SKIP_VISITED(stmt);
-    CounterMap[stmt] = NextCounter++;
+    CounterMap[stmt].Counter = NextCounter++;
     Hash.combine(PGOHash::CaseStmt);
     // Iff this statement is the target of a goto case statement, add an extra
     // counter for this case (as if it is a label statement).
     if (stmt->gototarget) {
-      CounterMap[CodeGenPGO::getCounterPtr(stmt, 1)] = NextCounter++;
+      CounterMap[CodeGenPGO::getCounterPtr(stmt, 1)].Counter = NextCounter++;
       Hash.combine(PGOHash::CaseGoto);
     }
   }
@@ -311,25 +311,25 @@ struct MapRegionCounters : public StoppableVisitor {
 
   void visit(DefaultStatement *stmt) override {
     SKIP_VISITED(stmt);
-    CounterMap[stmt] = NextCounter++;
+    CounterMap[stmt].Counter = NextCounter++;
     Hash.combine(PGOHash::DefaultStmt);
 
     // Iff this statement is the target of a goto case statement, add an extra
     // counter for this case (as if it is a label statement).
     if (stmt->gototarget) {
-      CounterMap[CodeGenPGO::getCounterPtr(stmt, 1)] = NextCounter++;
+      CounterMap[CodeGenPGO::getCounterPtr(stmt, 1)].Counter = NextCounter++;
       Hash.combine(PGOHash::CaseGoto);
     }
   }
 
   void visit(TryCatchStatement *stmt) override {
     SKIP_VISITED(stmt);
-    CounterMap[stmt] = NextCounter++;
+    CounterMap[stmt].Counter = NextCounter++;
     Hash.combine(PGOHash::TryCatchStmt);
     // Note that this results in the exception counters obtaining their counter
     // numbers before recursing into the counter handlers:
     for (auto c : *stmt->catches) {
-      CounterMap[c] = NextCounter++;
+      CounterMap[c].Counter = NextCounter++;
       Hash.combine(PGOHash::TryCatchCatch);
     }
   }
@@ -340,18 +340,18 @@ struct MapRegionCounters : public StoppableVisitor {
       return;
 
     SKIP_VISITED(stmt);
-    CounterMap[stmt] = NextCounter++;
+    CounterMap[stmt].Counter = NextCounter++;
     Hash.combine(PGOHash::TryFinallyStmt);
   }
   void visit(CondExp *expr) override {
     SKIP_VISITED(expr);
-    CounterMap[expr] = NextCounter++;
+    CounterMap[expr].Counter = NextCounter++;
     Hash.combine(PGOHash::ConditionalExpr);
   }
 
   void visit(LogicalExp *expr) override {
     SKIP_VISITED(expr);
-    CounterMap[expr] = NextCounter++;
+    CounterMap[expr].Counter = NextCounter++;
     Hash.combine(expr->op == EXP::andAnd ? PGOHash::AndAndExpr
                                          : PGOHash::OrOrExpr);
   }
@@ -376,7 +376,7 @@ struct ComputeRegionCounts : public RecursiveVisitor {
   uint64_t CurrentCount;
 
   /// The map of statements to count values.
-  llvm::DenseMap<const RootObject *, uint64_t> &CountMap;
+  CodeGenPGO::RegionMap &CountMap;
 
   /// BreakContinueStack - Keep counts of breaks and continues inside loops.
   struct BreakContinue {
@@ -396,13 +396,18 @@ struct ComputeRegionCounts : public RecursiveVisitor {
   };
   llvm::SmallVector<LoopLabel, 8> LoopLabels;
 
-  ComputeRegionCounts(llvm::DenseMap<const RootObject *, uint64_t> &CountMap,
-                      CodeGenPGO &PGO)
+  ComputeRegionCounts(CodeGenPGO::RegionMap &CountMap, CodeGenPGO &PGO)
       : PGO(PGO), RecordNextStmtCount(false), CountMap(CountMap) {}
 
+  void setStmtCount(const RootObject *S, uint64_t Count) {
+    auto &Region = CountMap[S];
+    Region.HasCount = true;
+    Region.Count = Count;
+  }
+
   void RecordStmtCount(const RootObject *S) {
     if (RecordNextStmtCount) {
-      CountMap[S] = CurrentCount;
+      setStmtCount(S, CurrentCount);
       RecordNextStmtCount = false;
     }
   }
@@ -418,7 +423,7 @@ struct ComputeRegionCounts : public RecursiveVisitor {
   void visit(FuncDeclaration *fd) override {
     // Counter tracks entry to the function body.
     uint64_t BodyCount = setCount(PGO.getRegionCount(fd->fbody));
-    CountMap[fd->fbody] = BodyCount;
+    setStmtCount(fd->fbody, BodyCount);
     recurse(fd->fbody);
   }
 
@@ -448,7 +453,7 @@ struct ComputeRegionCounts : public RecursiveVisitor {
     RecordNextStmtCount = false;
     // Counter tracks the block following the label.
     uint64_t BlockCount = setCount(PGO.getRegionCount(S));
-    CountMap[S] = BlockCount;
+    setStmtCount(S, BlockCount);
 
     // For each label pointing to a loop, store the current index of
     // BreakContinueStack. This is needed for `break label;` and `continue
@@ -534,7 +539,7 @@ struct ComputeRegionCounts : public RecursiveVisitor {
     // Visit the body region first so the break/continue adjustments can be
     // included when visiting the condition.
     uint64_t BodyCount = setCount(PGO.getRegionCount(S));
-    CountMap[S->_body] = CurrentCount;
+    setStmtCount(S->_body, CurrentCount);
     recurse(S->_body);
     uint64_t BackedgeCount = CurrentCount;
 
@@ -545,7 +550,7 @@ struct ComputeRegionCounts : public RecursiveVisitor {
     BreakContinue BC = BreakContinueStack.pop_back_val();
     uint64_t CondCount =
         setCount(ParentCount + BackedgeCount + BC.ContinueCount);
-    CountMap[S->condition] = CondCount;
+    setStmtCount(S->condition, CondCount);
     recurse(S->condition);
     setCount(BC.BreakCount + CondCount - BodyCount);
     RecordNextStmtCount = true;
@@ -557,7 +562,7 @@ struct ComputeRegionCounts : public RecursiveVisitor {
     // The instr count includes the fallthrough from the parent scope.
     BreakContinueStack.push_back(BreakContinue());
     uint64_t BodyCount = setCount(PGO.getRegionCount(S));
-    CountMap[S->_body] = BodyCount;
+    setStmtCount(S->_body, BodyCount);
     recurse(S->_body);
     uint64_t BackedgeCount = CurrentCount;
 
@@ -565,7 +570,7 @@ struct ComputeRegionCounts : public RecursiveVisitor {
     // The count at the start of the condition is equal to the count at the
     // end of the body, plus any continues.
     uint64_t CondCount = setCount(BackedgeCount + BC.ContinueCount);
-    CountMap[S->condition] = CondCount;
+    setStmtCount(S->condition, CondCount);
     recurse(S->condition);
     uint64_t LoopCount = BodyCount - FallThroughCount;
     setCount(BC.BreakCount + CondCount - LoopCount);
@@ -582,7 +587,7 @@ struct ComputeRegionCounts : public RecursiveVisitor {
     // Visit the body region first. (This is basically the same as a while
     // loop; see further comments in VisitWhileStmt.)
     uint64_t BodyCount = setCount(PGO.getRegionCount(S));
-    CountMap[S->_body] = BodyCount;
+    setStmtCount(S->_body, BodyCount);
     recurse(S->_body);
     uint64_t BackedgeCount = CurrentCount;
     BreakContinue BC = BreakContinueStack.pop_back_val();
@@ -591,7 +596,7 @@ struct ComputeRegionCounts : public RecursiveVisitor {
     // the count for all the continue statements.
     if (S->increment) {
       uint64_t IncCount = setCount(BackedgeCount + BC.ContinueCount);
-      CountMap[S->increment] = IncCount;
+      setStmtCount(S->increment, IncCount);
       recurse(S->increment);
     }
 
@@ -600,7 +605,8 @@ struct ComputeRegionCounts : public RecursiveVisitor {
         setCount(ParentCount + BackedgeCount + BC.ContinueCount);
 
     // If condition is nullptr, store CondCount in a derived ptr
-    CountMap[S->condition ? S->condition : PGO.getCounterPtr(S, 1)] = CondCount;
+    setStmtCount(S->condition ? S->condition : PGO.getCounterPtr(S, 1),
+                 CondCount);
     recurse(S->condition);
 
     setCount(BC.BreakCount + CondCount - BodyCount);
@@ -616,7 +622,7 @@ struct ComputeRegionCounts : public RecursiveVisitor {
     // Visit the body region first. (This is basically the same as a while
     // loop; see further comments in VisitWhileStmt.)
     uint64_t BodyCount = setCount(PGO.getRegionCount(S));
-    CountMap[S->_body] = BodyCount;
+    setStmtCount(S->_body, BodyCount);
     recurse(S->_body);
     uint64_t BackedgeCount = CurrentCount;
     BreakContinue BC = BreakContinueStack.pop_back_val();
@@ -624,7 +630,7 @@ struct ComputeRegionCounts : public RecursiveVisitor {
     uint64_t CondCount = ParentCount + BackedgeCount + BC.ContinueCount;
     // save the condition count as the second counter for the foreach statement
     // (there is no explicit condition statement).
-    CountMap[PGO.getCounterPtr(S, 1)] = CondCount;
+    setStmtCount(PGO.getCounterPtr(S, 1), CondCount);
 
     setCount(BC.BreakCount + CondCount - BodyCount);
     RecordNextStmtCount = true;
@@ -640,7 +646,7 @@ struct ComputeRegionCounts : public RecursiveVisitor {
     // Visit the body region first. (This is basically the same as a while
     // loop; see further comments in VisitWhileStmt.)
     uint64_t BodyCount = setCount(PGO.getRegionCount(S));
-    CountMap[S->_body] = BodyCount;
+    setStmtCount(S->_body, BodyCount);
     recurse(S->_body);
     uint64_t BackedgeCount = CurrentCount;
     BreakContinue BC = BreakContinueStack.pop_back_val();
@@ -648,7 +654,7 @@ struct ComputeRegionCounts : public RecursiveVisitor {
     uint64_t CondCount = ParentCount + BackedgeCount + BC.ContinueCount;
     // save the condition count as the second counter for the foreach statement
     // (there is no explicit condition statement).
-    CountMap[PGO.getCounterPtr(S, 1)] = CondCount;
+    setStmtCount(PGO.getCounterPtr(S, 1), CondCount);
 
     setCount(BC.BreakCount + CondCount - BodyCount);
     RecordNextStmtCount = true;
@@ -675,13 +681,13 @@ struct ComputeRegionCounts : public RecursiveVisitor {
     // this one. We need the count without fallthrough in the mapping, so it's
     // more useful for branch probabilities.
     uint64_t CaseCount = PGO.getRegionCount(S);
-    CountMap[S] = CaseCount;
+    setStmtCount(S, CaseCount);
 
     // If this Case is the target of a goto case, it will have its own extra
     // counter and behaves like a LabelStatement.
     if (S->gototarget) {
       RootObject *cntr = PGO.getCounterPtr(S, 1);
-      CountMap[cntr] = setCount(PGO.getRegionCount(cntr));
+      setStmtCount(cntr, setCount(PGO.getRegionCount(cntr)));
     } else {
       setCount(CurrentCount + CaseCount);
     }
@@ -693,10 +699,10 @@ struct ComputeRegionCounts : public RecursiveVisitor {
   void visit(DefaultStatement *S) override {
     // Identical to CaseStatement handler.
     uint64_t CaseCount = PGO.getRegionCount(S);
-    CountMap[S] = CaseCount;
+    setStmtCount(S, CaseCount);
     if (S->gototarget) {
       RootObject *cntr = PGO.getCounterPtr(S, 1);
-      CountMap[cntr] = setCount(PGO.getRegionCount(cntr));
+      setStmtCount(cntr, setCount(PGO.getRegionCount(cntr)));
     } else {
       setCount(CurrentCount + CaseCount);
     }
@@ -726,14 +732,14 @@ struct ComputeRegionCounts : public RecursiveVisitor {
     // Counter tracks the "then" part of an if statement. The count for
     // the "else" part, if it exists, will be calculated from this counter.
     uint64_t ThenCount = setCount(PGO.getRegionCount(S));
-    CountMap[S->ifbody] = ThenCount;
+    setStmtCount(S->ifbody, ThenCount);
     recurse(S->ifbody);
     uint64_t OutCount = CurrentCount;
 
     uint64_t ElseCount = ParentCount - ThenCount;
     if (S->elsebody) {
       setCount(ElseCount);
-      CountMap[S->elsebody] = ElseCount;
+      setStmtCount(S->elsebody, ElseCount);
       recurse(S->elsebody);
       OutCount += CurrentCount;
     } else {
@@ -792,12 +798,12 @@ struct ComputeRegionCounts : public RecursiveVisitor {
     // Counter tracks the "true" part of a conditional operator. The
     // count in the "false" part will be calculated from this counter.
     uint64_t TrueCount = setCount(PGO.getRegionCount(E));
-    CountMap[E->e1] = TrueCount;
+    setStmtCount(E->e1, TrueCount);
     recurse(E->e1);
     uint64_t OutCount = CurrentCount;
 
     uint64_t FalseCount = setCount(ParentCount - TrueCount);
-    CountMap[E->e2] = FalseCount;
+    setStmtCount(E->e2, FalseCount);
     recurse(E->e2);
     OutCount += CurrentCount;
 
@@ -811,7 +817,7 @@ struct ComputeRegionCounts : public RecursiveVisitor {
     recurse(E->e1);
     // Counter tracks the right hand side of a logical operator.
     uint64_t RHSCount = setCount(PGO.getRegionCount(E));
-    CountMap[E->e2] = RHSCount;
+    setStmtCount(E->e2, RHSCount);
     recurse(E->e2);
     setCount(ParentCount + RHSCount - CurrentCount);
     RecordNextStmtCount = true;
@@ -868,26 +874,32 @@ void CodeGenPGO::assignRegionCounters(const FuncDeclaration *D,
   mapRegionCounters(D);
   if (PGOReader) {
     loadRegionCounts(PGOReader, D);
-    computeRegionCounts(D);
     applyFunctionAttributes(fn);
+    // If the function has never been executed, there are no branch weights to
+    // compute: skip the propagation of the counts through the AST (most
+    // template instances).
+    if (llvm::all_of(RegionCounts, [](uint64_t Count) { return Count == 0; }))
+      RegionCounts.clear();
+    else
+      computeRegionCounts(D);
   }
 }
 
 void CodeGenPGO::mapRegionCounters(const FuncDeclaration *D) {
-  RegionCounterMap.reset(new llvm::DenseMap<const RootObject *, unsigned>);
-  MapRegionCounters regioncounter(*RegionCounterMap);
+  Regions.clear();
+  MapRegionCounters regioncounter(Regions);
   RecursiveWalker walker(&regioncounter);
 
   walker.visit(const_cast<FuncDeclaration *>(D));
   assert(regioncounter.NextCounter > 0 && "no entry counter mapped for decl");
-  assert(regioncounter.NextCounter == RegionCounterMap->size());
+  assert(regioncounter.NextCounter == Regions.size());
   NumRegionCounters = regioncounter.NextCounter;
   FunctionHash = regioncounter.Hash.finalize();
 }
 
 void CodeGenPGO::computeRegionCounts(const FuncDeclaration *FD) {
-  StmtCountMap.reset(new llvm::DenseMap<const RootObject *, uint64_t>);
-  ComputeRegionCounts Walker(*StmtCountMap, *this);
+  // The counts are added to the entries of the counters
+  ComputeRegionCounts Walker(Regions, *this);
   Walker.visit(const_cast<FuncDeclaration *>(FD));
 }
 
@@ -896,19 +908,20 @@ void CodeGenPGO::applyFunctionAttributes(llvm::Function *Fn) {
   if (!haveRegionCounts())
     return;
 
-  uint64_t FunctionCount = getRegionCount(nullptr);
+  uint64_t FunctionCount = RegionCounts[0];
   Fn->setEntryCount(FunctionCount);
 }
 
 void CodeGenPGO::emitCounterIncrement(const RootObject *S) const {
-  if (!opts::isInstrumentingForASTBasedPGO() || !RegionCounterMap ||
+  if (!opts::isInstrumentingForASTBasedPGO() || Regions.empty() ||
       !emitInstrumentation)
     return;
 
-  auto counter_it = (*RegionCounterMap).find(S);
-  assert(counter_it != (*RegionCounterMap).end() &&
+  auto counter_it = Regions.find(S);
+  assert(counter_it != Regions.end() &&
+         counter_it->second.Counter != RegionInfo::NoCounter &&
          "Statement not found in PGO counter map!");
-  unsigned counter = counter_it->second;
+  unsigned counter = counter_it->second.Counter;
   gIR->ir->CreateCall(GET_INTRINSIC_DECL(instrprof_increment, {}),
                       {FuncNameVar, gIR->ir->getInt64(FunctionHash),
                        gIR->ir->getInt32(NumRegionCounters),
@@ -1106,7 +1119,7 @@ void CodeGenPGO::valueProfile(uint32_t valueKind, llvm::Instruction *valueSite,
 
   bool instrumentValueSites =
       opts::isInstrumentingForASTBasedPGO() && emitInstrumentation;
-  if (instrumentValueSites && RegionCounterMap) {
+  if (instrumentValueSites && !Regions.empty()) {
     // Instrumentation must be inserted just before the valueSite instruction.
     // Save the current insertion point to be able to restore it later.
     auto savedInsertPoint = gIR->ir->saveIP();
@@ -39,6 +39,16 @@ class ForeachRangeStatement;
 /// Keeps per-function PGO state.
 class CodeGenPGO {
 public:
+  /// The region counter and the execution count (computed from the profile
+  /// data) of an AST node. Both are kept in one map per function.
+  struct RegionInfo {
+    static constexpr unsigned NoCounter = ~0u;
+    unsigned Counter = NoCounter;
+    bool HasCount = false;
+    uint64_t Count = 0;
+  };
+  using RegionMap = llvm::DenseMap<const RootObject *, RegionInfo>;
+
   CodeGenPGO()
       : NumRegionCounters(0), FunctionHash(0), CurrentRegionCount(0),
         NumValueSites({{0}}) {}
@@ -88,11 +98,13 @@ public:
 
   /// Return the region count for the counter at the given index.
   uint64_t getRegionCount(const RootObject *S) const {
-    if (!RegionCounterMap)
-      return 0;
     if (!haveRegionCounts())
       return 0;
-    return RegionCounts[(*RegionCounterMap)[S]];
+    // Nodes without counter get the function entry count.
+    auto I = Regions.find(S);
+    if (I == Regions.end() || I->second.Counter == RegionInfo::NoCounter)
+      return RegionCounts[0];
+    return RegionCounts[I->second.Counter];
   }
 
   llvm::MDNode *createProfileWeights(uint64_t TrueCount,
@@ -136,9 +148,7 @@ private:
 
   unsigned NumRegionCounters;
   uint64_t FunctionHash;
-  std::unique_ptr<llvm::DenseMap<const RootObject *, unsigned>>
-      RegionCounterMap;
-  std::unique_ptr<llvm::DenseMap<const RootObject *, uint64_t>> StmtCountMap;
+  RegionMap Regions;
   std::vector<uint64_t> RegionCounts;
   uint64_t CurrentRegionCount;
 
@@ -152,12 +162,10 @@ private:
   /// Check if an execution count is known for a given statement. If so, return
   /// true and put the value in pair::second; else return false.
   std::pair<bool, uint64_t> getStmtCount(const RootObject *S) const {
-    if (!StmtCountMap)
-      return std::make_pair(false, 0);
-    auto I = StmtCountMap->find(S);
-    if (I == StmtCountMap->end())
+    auto I = Regions.find(S);
+    if (I == Regions.end() || !I->second.HasCount)
       return std::make_pair(false, 0);
-    return std::make_pair(true, I->second);
+    return std::make_pair(true, I->second.Count);
   }
 
   void setFuncName(llvm::Function *Fn);
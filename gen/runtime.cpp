@@ -26,6 +26,7 @@
 #include "gen/llvmhelpers.h"
 #include "gen/logger.h"
 #include "gen/mangling.h"
+#include "gen/passes/metadata.h"
 #include "gen/tollvm.h"
 #include "ir/irfunction.h"
 #include "ir/irtype.h"
@@ -64,6 +65,10 @@ static void checkForImplicitGCCall(const Loc &loc, const char *name) {
     static const std::string GCNAMES[] = {
         "_aaDelX",
         "_aaGetY",
+        "_aaGetY_ptr",
+        "_aaGetY_str",
+        "_aaGetY_u32",
+        "_aaGetY_u64",
         "_aaKeys",
         "_aaNew",
         "_aaRehash",
@@ -277,6 +282,12 @@ struct LazyFunctionDeclarer {
       }
 
       fn->setCallingConv(gABI->callingConv(dty, false));
+
+      // Tag the druntime hooks known to the LDC passes with their ID.
+      const auto hookID = getRuntimeHookID(fname);
+      if (hookID != RH_None) {
+        setRuntimeHookID(fn, hookID);
+      }
     }
   }
 };
@@ -328,12 +339,16 @@ llvm::Function *getRuntimeFunction(const Loc &loc, llvm::Module &target,
     assert(fn);
   }
   LLFunctionType *fnty = fn->getFunctionType();
+  llvm::MDNode *hookMD = fn->getMetadata(RT_HOOK_MD);
 
   if (LLFunction *existing = target.getFunction(name)) {
     if (existing->getFunctionType() != fnty) {
       error(Loc(), "Incompatible declaration of runtime function `%s`", name);
       fatal();
     }
+    if (hookMD && existing->isDeclaration()) {
+      existing->setMetadata(RT_HOOK_MD, hookMD);
+    }
     return existing;
   }
 
@@ -341,6 +356,9 @@ llvm::Function *getRuntimeFunction(const Loc &loc, llvm::Module &target,
       target.getOrInsertFunction(name, fnty).getCallee());
   resfn->setAttributes(fn->getAttributes());
   resfn->setCallingConv(fn->getCallingConv());
+  if (hookMD) {
+    resfn->setMetadata(RT_HOOK_MD, hookMD);
+  }
   return resfn;
 }
 
@@ -716,14 +734,21 @@ static void buildRuntimeModule() {
 
   // void* _aaGetY(AA* aa, const TypeInfo aati, in size_t valuesize,
   //               in void* pkey)
-  createFwdDecl(LINK::c, voidPtrTy, {"_aaGetY"},
+  // + the variants specialized for the key type (see rt.aaA)
+  createFwdDecl(LINK::c, voidPtrTy,
+                {"_aaGetY", "_aaGetY_str", "_aaGetY_u32", "_aaGetY_u64",
+                 "_aaGetY_ptr"},
                 {pointerTo(aaTy), aaTypeInfoTy, sizeTy, voidPtrTy},
                 {0, STCconst, STCin, STCin}, Attr_1_4_NoCapture);
 
   // inout(void)* _aaInX(inout AA aa, in TypeInfo keyti, in void* pkey)
+  // + the variants specialized for the key type
   // FIXME: "inout" storageclass is not applied to return type
-  createFwdDecl(LINK::c, voidPtrTy, {"_aaInX"}, {aaTy, typeInfoTy, voidPtrTy},
-                {STCin | STCout, STCin, STCin}, Attr_ReadOnly_1_3_NoCapture);
+  createFwdDecl(LINK::c, voidPtrTy,
+                {"_aaInX", "_aaInX_str", "_aaInX_u32", "_aaInX_u64",
+                 "_aaInX_ptr"},
+                {aaTy, typeInfoTy, voidPtrTy}, {STCin | STCout, STCin, STCin},
+                Attr_ReadOnly_1_3_NoCapture);
 
   // bool _aaDelX(AA aa, in TypeInfo keyti, in void* pkey)
   createFwdDecl(LINK::c, boolTy, {"_aaDelX"}, {aaTy, typeInfoTy, voidPtrTy},
@@ -822,6 +847,10 @@ static void buildRuntimeModule() {
   if (global.params.cov) {
     createFwdDecl(LINK::c, voidTy, {"_d_cover_register2"},
                   {stringTy, arrayOf(sizeTy), arrayOf(uintTy), ubyteTy});
+    // extern (C) void _d_cover_register_merge(void function() merge,
+    //                                         bool perThread)
+    createFwdDecl(LINK::c, voidTy, {"_d_cover_register_merge"},
+                  {voidPtrTy, boolTy});
   }
 
   //////////////////////////////////////////////////////////////////////////////
@@ -911,6 +940,15 @@ static void buildRuntimeModule() {
   // extern(C) void _c_trace_epi()
   createFwdDecl(LINK::c, voidTy, {"_c_trace_epi"}, {});
 
+  //////////////////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////////////////
+  ////// -ftrace-functions calls
+
+  // extern(C) void _d_trace_enter(FunctionTraceInfo* info)
+  // extern(C) void _d_trace_exit(FunctionTraceInfo* info)
+  createFwdDecl(LINK::c, voidTy, {"_d_trace_enter", "_d_trace_exit"},
+                {voidPtrTy});
+
   //////////////////////////////////////////////////////////////////////////////
   //////////////////////////////////////////////////////////////////////////////
   ////// C standard library functions (a druntime link dependency)
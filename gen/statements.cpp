@@ -18,6 +18,7 @@
 #include "dmd/module.h"
 #include "dmd/mtype.h"
 #include "dmd/root/port.h"
+#include "dmd/template.h"
 #include "gen/abi/abi.h"
 #include "gen/arrays.h"
 #include "gen/classes.h"
@@ -30,6 +31,7 @@
 #include "gen/llvm.h"
 #include "gen/llvmhelpers.h"
 #include "gen/logger.h"
+#include "gen/optimizer.h"
 #include "gen/recursivevisitor.h"
 #include "gen/runtime.h"
 #include "gen/tollvm.h"
@@ -38,6 +40,7 @@
 #include "llvm/IR/CFG.h"
 #include "llvm/IR/InlineAsm.h"
 #include <fstream>
+#include <map>
 #include <math.h>
 #include <stdio.h>
 
@@ -67,6 +70,129 @@ bool isAssertFalse(Statement *s) {
     return isAssertFalse(ss->statement);
   return false;
 }
+
+/// Emits the dispatch of a string switch over the `labels` of one length,
+/// adding the resulting case index to `result`: branches on the code unit
+/// which distinguishes most of the remaining labels until a single candidate
+/// is left, which is verified with one memcmp.
+void emitStringSwitchDispatch(IRState &irs, LLValue *ptr, LLType *charType,
+                              llvm::ArrayRef<unsigned> candidates,
+                              llvm::ArrayRef<StringExp *> labels,
+                              llvm::BasicBlock *notFoundBB,
+                              llvm::BasicBlock *endBB, llvm::PHINode *result) {
+  auto resultType = result->getType();
+  const size_t length = labels[candidates[0]]->len;
+
+  if (candidates.size() == 1) {
+    const unsigned index = candidates[0];
+    LLValue *found = irs.ir->getTrue();
+    if (length != 0) {
+      StringExp *label = labels[index];
+      LLValue *cmp = DtoMemCmp(ptr, irs.getCachedStringLiteral(label),
+                               DtoConstSize_t(length * label->sz));
+      found = irs.ir->CreateICmpEQ(cmp, DtoConstInt(0));
+    }
+    result->addIncoming(
+        irs.ir->CreateSelect(found, llvm::ConstantInt::get(resultType, index),
+                             llvm::ConstantInt::getSigned(resultType,
+                                                          INT32_MIN)),
+        irs.scopebb());
+    irs.ir->CreateBr(endBB);
+    return;
+  }
+
+  // the position with the most distinct code units
+  size_t bestPosition = 0;
+  std::map<char32_t, llvm::SmallVector<unsigned, 4>> bestGroups;
+  for (size_t i = 0; i < length; ++i) {
+    std::map<char32_t, llvm::SmallVector<unsigned, 4>> groups;
+    for (unsigned index : candidates)
+      groups[labels[index]->getCodeUnit(i)].push_back(index);
+    if (groups.size() > bestGroups.size()) {
+      bestPosition = i;
+      bestGroups = std::move(groups);
+    }
+  }
+  assert(bestGroups.size() > 1 && "duplicate string switch labels");
+
+  LLValue *codeUnit = DtoLoad(charType, DtoGEP1(charType, ptr, bestPosition));
+  auto si = irs.ir->CreateSwitch(codeUnit, notFoundBB, bestGroups.size());
+  for (const auto &group : bestGroups) {
+    auto bb = irs.insertBB("strswitch.unit");
+    si->addCase(llvm::ConstantInt::get(llvm::cast<llvm::IntegerType>(charType),
+                                       group.first),
+                bb);
+    irs.ir->SetInsertPoint(bb);
+    emitStringSwitchDispatch(irs, ptr, charType, group.second, labels,
+                             notFoundBB, endBB, result);
+  }
+}
+
+/// Emits the frontend's lowering of a string switch condition,
+/// `object.__switch!(T, sortedLabels...)(condition)`, as a switch on the
+/// length, then on distinguishing code units, and a final memcmp instead of
+/// the runtime binary search. The result is the index of the matching label
+/// or `int.min`, like `__switch`. Returns null if `e` is no such call.
+LLValue *emitStringSwitchCondition(IRState &irs, Expression *e) {
+  auto ce = e->isCallExp();
+  if (!ce || !ce->f || ce->f->ident != Id::__switch || !ce->arguments ||
+      ce->arguments->length != 1) {
+    return nullptr;
+  }
+  auto ti = ce->f->parent ? ce->f->parent->isTemplateInstance() : nullptr;
+  if (!ti || !ti->tiargs || ti->tiargs->length < 2) {
+    return nullptr;
+  }
+
+  Type *charType = isType((*ti->tiargs)[0]);
+  if (!charType) {
+    return nullptr;
+  }
+  const auto charSize = size(charType);
+  llvm::SmallVector<StringExp *, 16> labels;
+  for (size_t i = 1; i < ti->tiargs->length; ++i) {
+    auto label = isExpression((*ti->tiargs)[i]);
+    auto se = label ? label->isStringExp() : nullptr;
+    if (!se || se->sz != charSize) {
+      return nullptr;
+    }
+    labels.push_back(se);
+  }
+
+  IF_LOG Logger::println("Inline string switch dispatch over %u labels",
+                         static_cast<unsigned>(labels.size()));
+  LOG_SCOPE;
+
+  DValue *str = toElemDtor((*ce->arguments)[0]);
+  LLValue *length = DtoArrayLen(str);
+  LLValue *ptr = DtoArrayPtr(str);
+
+  auto resultType = DtoType(ce->type);
+  auto endBB = irs.insertBB("strswitch.end");
+  auto result = llvm::PHINode::Create(resultType, labels.size() + 1,
+                                      "strswitch.index", endBB);
+  auto notFoundBB = irs.insertBBBefore(endBB, "strswitch.notfound");
+  result->addIncoming(llvm::ConstantInt::getSigned(resultType, INT32_MIN),
+                      notFoundBB);
+  llvm::BranchInst::Create(endBB, notFoundBB);
+
+  std::map<size_t, llvm::SmallVector<unsigned, 4>> lengthGroups;
+  for (unsigned i = 0; i < labels.size(); ++i)
+    lengthGroups[labels[i]->len].push_back(i);
+
+  auto si = irs.ir->CreateSwitch(length, notFoundBB, lengthGroups.size());
+  for (const auto &group : lengthGroups) {
+    auto bb = irs.insertBBBefore(notFoundBB, "strswitch.length");
+    si->addCase(llvm::cast<llvm::ConstantInt>(DtoConstSize_t(group.first)),
+                bb);
+    irs.ir->SetInsertPoint(bb);
+    emitStringSwitchDispatch(irs, ptr, DtoMemType(charType), group.second,
+                             labels, notFoundBB, endBB, result);
+  }
+
+  irs.ir->SetInsertPoint(endBB);
+  return result;
+}
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -1015,8 +1141,13 @@ public:
 
     irs->ir->SetInsertPoint(oldbb);
     if (useSwitchInst) {
-      // The case index value.
-      LLValue *condVal = DtoRVal(toElemDtor(stmt->condition));
+      // The case index value. The string switch lowering is dispatched
+      // inline with optimizations.
+      LLValue *condVal = isOptimizationEnabled()
+                             ? emitStringSwitchCondition(*irs, stmt->condition)
+                             : nullptr;
+      if (!condVal)
+        condVal = DtoRVal(toElemDtor(stmt->condition));
 
       // Create switch and add the cases.
       // For PGO instrumentation, we need to add counters /before/ the case
@@ -26,6 +26,7 @@
 #include "ir/iraggr.h"
 #include "ir/irdsymbol.h"
 #include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/Support/ManagedStatic.h"
 #include <algorithm>
 
@@ -99,6 +100,104 @@ LLValue *DtoStructEquals(EXP op, DValue *lhs, DValue *rhs) {
 
 ////////////////////////////////////////////////////////////////////////////////
 
+namespace {
+/// Upper limit for the number of non-zero scalars of an aggregate initializer
+/// to be stored individually instead of copying the init symbol.
+constexpr unsigned maxInitStores = 8;
+
+using InitParts = llvm::SmallVector<std::pair<uint64_t, LLConstant *>, 8>;
+
+/// Collects the non-zero scalars (incl. vectors) of the initializer with their
+/// byte offset, ignoring the ones before startOffset. Returns false if there
+/// are more than maxInitStores.
+bool collectNonZeroParts(LLConstant *c, uint64_t offset, uint64_t startOffset,
+                         InitParts &parts) {
+  if (c->isNullValue() || llvm::isa<llvm::UndefValue>(c)) {
+    return true;
+  }
+
+  LLType *type = c->getType();
+  if (auto st = llvm::dyn_cast<llvm::StructType>(type)) {
+    const auto layout = gDataLayout->getStructLayout(st);
+    for (unsigned i = 0; i < st->getNumElements(); ++i) {
+      const uint64_t elementOffset = offset + layout->getElementOffset(i);
+      if (!collectNonZeroParts(c->getAggregateElement(i), elementOffset,
+                               startOffset, parts)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  if (auto at = llvm::dyn_cast<llvm::ArrayType>(type)) {
+    const uint64_t elementSize = getTypeAllocSize(at->getElementType());
+    for (unsigned i = 0; i < at->getNumElements(); ++i) {
+      if (!collectNonZeroParts(c->getAggregateElement(i),
+                               offset + i * elementSize, startOffset, parts)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  if (offset < startOffset) {
+    return true;
+  }
+  if (parts.size() == maxInitStores) {
+    return false;
+  }
+  parts.emplace_back(offset, c);
+  return true;
+}
+}
+
+void DtoInitAggregate(AggregateDeclaration *ad, LLValue *dst,
+                      unsigned alignment, uint64_t startOffset) {
+  const uint64_t size = ad->structsize;
+  if (size <= startOffset) {
+    return;
+  }
+
+  IrAggr *irAggr = getIrAggr(ad);
+  const auto atOffset = [](LLValue *ptr, uint64_t offset) {
+    return offset == 0 ? ptr : DtoGEP1i64(getI8Type(), ptr, offset);
+  };
+  LLValue *const dstPtr = atOffset(dst, startOffset);
+  const uint64_t numBytes = size - startOffset;
+
+  InitParts parts;
+  if (!collectNonZeroParts(irAggr->getDefaultInit(), 0, startOffset, parts)) {
+    IF_LOG Logger::println("copying init symbol of %s", ad->toChars());
+    LLValue *initsym = irAggr->getInitSymbol();
+    DtoMemCpy(dstPtr, atOffset(initsym, startOffset),
+              DtoConstSize_t(numBytes));
+    return;
+  }
+
+  IF_LOG Logger::println("storing %u non-zero parts of the init of %s",
+                         static_cast<unsigned>(parts.size()), ad->toChars());
+
+  const llvm::Align dstAlignment(alignment);
+
+  // Zero everything (incl. padding) not overwritten by the stores.
+  uint64_t storedBytes = 0;
+  for (const auto &part : parts) {
+    storedBytes += getTypeStoreSize(part.second->getType());
+  }
+  if (storedBytes < numBytes) {
+    DtoMemSetZero(getI8Type(), dstPtr, DtoConstSize_t(numBytes),
+                  llvm::commonAlignment(dstAlignment, startOffset).value());
+  }
+
+  for (const auto &part : parts) {
+    const auto partAlignment = llvm::commonAlignment(dstAlignment, part.first);
+    gIR->ir->CreateAlignedStore(part.second, atOffset(dst, part.first),
+                                partAlignment);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 /// Return the type returned by DtoUnpaddedStruct called on a value of the
 /// specified type.
 /// Union types will get expanded into a struct, with a type for each member.
@@ -16,6 +16,7 @@
 #include "dmd/tokens.h"
 #include <vector>
 
+class AggregateDeclaration;
 class DValue;
 class StructDeclaration;
 class StructInitializer;
@@ -41,6 +42,14 @@ void DtoResolveStruct(StructDeclaration *sd, const Loc &callerLoc);
 /// Returns a boolean=true if the two structs are equal.
 llvm::Value *DtoStructEquals(EXP op, DValue *lhs, DValue *rhs);
 
+/// Default-initializes the struct or class instance at dst, known to be
+/// aligned to `alignment` bytes, starting at the specified byte offset (e.g.,
+/// after the vtbl and monitor of class objects).
+/// If the initializer is mostly zero, the memory is zeroed and the remaining
+/// parts are stored directly; otherwise, the init symbol is copied.
+void DtoInitAggregate(AggregateDeclaration *ad, llvm::Value *dst,
+                      unsigned alignment = 1, uint64_t startOffset = 0);
+
 /// Return the type returned by DtoUnpaddedStruct called on a value of the
 /// specified type.
 /// Union types will get expanded into a struct, with a type for each member.
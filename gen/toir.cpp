@@ -1274,7 +1274,7 @@ public:
           }
         }
 
-        p->ir->CreateCondBr(okCond, okbb, failbb);
+        emitBoundsCheckBranch(p, okCond, okbb, failbb);
 
         p->ir->SetInsertPoint(failbb);
         emitArraySliceError(p, e->loc, vlo, vup,
@@ -2396,15 +2396,18 @@ public:
       StructDeclaration *sd = e->sd;
       DtoResolveStruct(sd);
 
-      if (!dstMem)
+      // a caller-provided dstMem may be under-aligned, e.g. a field of a
+      // packed struct
+      unsigned alignment = 1;
+      if (!dstMem) {
         dstMem = DtoAlloca(e->type, ".structliteral");
+        alignment = DtoAlignment(e->type);
+      }
 
       if (sd->zeroInit()) {
         DtoMemSetZero(DtoType(e->type), dstMem);
       } else {
-        LLValue *initsym = getIrAggr(sd)->getInitSymbol();
-        assert(dstMem->getType() == initsym->getType());
-        DtoMemCpy(DtoType(e->type), dstMem, initsym);
+        DtoInitAggregate(sd, dstMem, alignment);
       }
 
       return new DLValue(e->type, dstMem);
@@ -2909,6 +2912,12 @@ bool toInPlaceConstruction(DLValue *lhs, Expression *rhs) {
           DtoMemSetZero(DtoType(lhs->type) ,DtoLVal(lhs));
           return true;
         }
+        if (basetypesAreEqualWithoutModifiers(lhs->type, symdecl->type)) {
+          Logger::println("success, default-initializing");
+          // the lhs may be under-aligned, e.g. a field of a packed struct
+          DtoInitAggregate(sd, DtoLVal(lhs));
+          return true;
+        }
       }
     }
   }
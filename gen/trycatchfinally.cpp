@@ -495,8 +495,10 @@ void TryCatchFinallyScopes::pushTryCatch(TryCatchStatement *stmt,
   // catches.
   tryCatchScopes.push_back(scope);
 
-  if (!useMSVCEH())
+  if (!useMSVCEH()) {
     landingPadsPerCleanupScope[currentCleanupScope()].push_back(nullptr);
+    catchDispatchBlocks.push_back(nullptr);
+  }
 }
 
 void TryCatchFinallyScopes::popTryCatch() {
@@ -506,6 +508,7 @@ void TryCatchFinallyScopes::popTryCatch() {
     popCleanups(currentCleanupScope() - 1);
   } else {
     landingPadsPerCleanupScope[currentCleanupScope()].pop_back();
+    catchDispatchBlocks.pop_back();
   }
 }
 
@@ -672,6 +675,67 @@ namespace {
 }
 }
 
+llvm::BasicBlock *
+TryCatchFinallyScopes::getCatchDispatchBlock(size_t tryCatchIndex) {
+  llvm::BasicBlock *&dispatchBB = catchDispatchBlocks[tryCatchIndex];
+  if (dispatchBB)
+    return dispatchBB;
+
+  // Where to continue if no catch matches: the 'if' chain of the next outer
+  // try-catch scope, or resuming unwinding.
+  const CleanupCursor cleanupScope =
+      tryCatchScopes[tryCatchIndex].getCleanupScope();
+  const CleanupCursor outerCleanupScope =
+      tryCatchIndex > 0 ? tryCatchScopes[tryCatchIndex - 1].getCleanupScope()
+                        : 0;
+  llvm::BasicBlock *outerBB = tryCatchIndex > 0
+                                  ? getCatchDispatchBlock(tryCatchIndex - 1)
+                                  : getOrCreateResumeUnwindBlock();
+
+  const auto savedInsertPoint = irs.saveInsertPoint();
+
+  llvm::BasicBlock *beginBB = irs.insertBBBefore(nullptr, "catch.dispatch");
+  irs.ir->SetInsertPoint(beginBB);
+
+  const auto ehSelectorType = ehSelectorSlot->getAllocatedType();
+  const auto &catchBlocks = tryCatchScopes[tryCatchIndex].getCatchBlocks();
+  assert(!catchBlocks.empty());
+  for (size_t i = 0; i < catchBlocks.size(); ++i) {
+    const auto &cb = catchBlocks[i];
+
+    // Without any cleanups in between, directly continue with the outer
+    // scope after the last mismatch.
+    const bool isLast = i + 1 == catchBlocks.size();
+    llvm::BasicBlock *mismatchBB =
+        isLast && cleanupScope == outerCleanupScope
+            ? outerBB
+            : irs.insertBB(beginBB->getName() + llvm::Twine(".mismatch"));
+
+    // "Call" llvm.eh.typeid.for, which gives us the eh selector value to
+    // compare the landing pad selector value with.
+    llvm::Value *ehTypeId = irs.ir->CreateCall(
+        GET_INTRINSIC_DECL(eh_typeid_for, cb.classInfoPtr->getType()),
+        cb.classInfoPtr);
+
+    // Compare the selector value from the unwinder against the expected
+    // one and branch accordingly.
+    irs.ir->CreateCondBr(
+        irs.ir->CreateICmpEQ(
+            irs.ir->CreateLoad(ehSelectorType, ehSelectorSlot), ehTypeId),
+        cb.bodyBB, mismatchBB, cb.branchWeights);
+    if (mismatchBB != outerBB)
+      irs.ir->SetInsertPoint(mismatchBB);
+  }
+
+  // No catch matched. Execute the finallys in between and continue with the
+  // outer try-catch scope.
+  if (cleanupScope != outerCleanupScope)
+    runCleanups(cleanupScope, outerCleanupScope, outerBB);
+
+  dispatchBB = beginBB;
+  return dispatchBB;
+}
+
 llvm::BasicBlock *TryCatchFinallyScopes::emitLandingPad() {
   if (useMSVCEH()) {
     assert(currentCleanupScope() > 0);
@@ -699,61 +763,27 @@ llvm::BasicBlock *TryCatchFinallyScopes::emitLandingPad() {
     ehSelectorSlot = DtoRawAlloca(ehSelectorType, 0, "eh.selector");
   irs.ir->CreateStore(ehSelector, ehSelectorSlot);
 
-  // Add landingpad clauses, emit finallys and 'if' chain to catch the
-  // exception.
-  CleanupCursor lastCleanup = currentCleanupScope();
+  // Add the ClassInfo references of all active catches to the landingpad
+  // instruction, so that they are emitted to the EH tables.
   for (auto it = tryCatchScopes.rbegin(), end = tryCatchScopes.rend();
        it != end; ++it) {
-    const auto &tryCatchScope = *it;
-
-    // Insert any cleanups in between the previous (inner-more) try-catch scope
-    // and this one.
-    const auto newCleanup = tryCatchScope.getCleanupScope();
-    assert(lastCleanup >= newCleanup);
-    if (lastCleanup > newCleanup) {
-      landingPad->setCleanup(true);
-      llvm::BasicBlock *afterCleanupBB =
-          irs.insertBB(beginBB->getName() + llvm::Twine(".after.cleanup"));
-      runCleanups(lastCleanup, newCleanup, afterCleanupBB);
-      irs.ir->SetInsertPoint(afterCleanupBB);
-      lastCleanup = newCleanup;
-    }
-
-    for (const auto &cb : tryCatchScope.getCatchBlocks()) {
-      // Add the ClassInfo reference to the landingpad instruction so it is
-      // emitted to the EH tables.
+    for (const auto &cb : it->getCatchBlocks())
       landingPad->addClause(cb.classInfoPtr);
-
-      llvm::BasicBlock *mismatchBB =
-          irs.insertBB(beginBB->getName() + llvm::Twine(".mismatch"));
-
-      // "Call" llvm.eh.typeid.for, which gives us the eh selector value to
-      // compare the landing pad selector value with.
-      llvm::Value *ehTypeId = irs.ir->CreateCall(
-          GET_INTRINSIC_DECL(eh_typeid_for, cb.classInfoPtr->getType()), cb.classInfoPtr);
-
-      // Compare the selector value from the unwinder against the expected
-      // one and branch accordingly.
-      irs.ir->CreateCondBr(
-          irs.ir->CreateICmpEQ(
-              irs.ir->CreateLoad(ehSelectorType, ehSelectorSlot), ehTypeId),
-          cb.bodyBB, mismatchBB, cb.branchWeights);
-      irs.ir->SetInsertPoint(mismatchBB);
-    }
   }
 
-  // No catch matched. Execute all finallys and resume unwinding.
-  auto resumeUnwindBlock = getOrCreateResumeUnwindBlock();
-  if (lastCleanup > 0) {
+  if (currentCleanupScope() > 0)
     landingPad->setCleanup(true);
-    runCleanups(lastCleanup, 0, resumeUnwindBlock);
-  } else if (!tryCatchScopes.empty()) {
-    // Directly convert the last mismatch branch into a branch to the
-    // unwind resume block.
-    irs.scopebb()->replaceAllUsesWith(resumeUnwindBlock);
-    irs.scopebb()->eraseFromParent();
+
+  // Execute the finallys inside the innermost try-catch scope and continue
+  // with its (shared) 'if' chain to catch the exception. Without any catches,
+  // execute all finallys and resume unwinding.
+  if (tryCatchScopes.empty()) {
+    runCleanups(currentCleanupScope(), 0, getOrCreateResumeUnwindBlock());
   } else {
-    irs.ir->CreateBr(resumeUnwindBlock);
+    const size_t innermost = tryCatchScopes.size() - 1;
+    runCleanups(currentCleanupScope(),
+                tryCatchScopes[innermost].getCleanupScope(),
+                getCatchDispatchBlock(innermost));
   }
 
   return beginBB;
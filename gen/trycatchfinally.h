@@ -276,6 +276,16 @@ private:
 
   llvm::BasicBlock *&getLandingPadRef(CleanupCursor scope);
 
+  /// catchDispatchBlocks[i] matches the exception against the catches of
+  /// tryCatchScopes[i] (and, on mismatch, runs the cleanups in between and
+  /// continues with the outer try-catch scopes), or is null if not emitted
+  /// yet. It is shared by all landing pads inside that try-catch scope, so
+  /// that the type checks are only emitted once per scope instead of once per
+  /// nested cleanup scope.
+  std::vector<llvm::BasicBlock *> catchDispatchBlocks;
+
+  llvm::BasicBlock *getCatchDispatchBlock(size_t tryCatchIndex);
+
   /// Emits a landing pad to honor all the active cleanups and catches.
   llvm::BasicBlock *emitLandingPad();
 
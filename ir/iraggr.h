@@ -131,6 +131,9 @@ public:
   /// Creates the __ClassZ/__InterfaceZ symbol lazily.
   llvm::GlobalVariable *getClassInfoSymbol(bool define = false);
 
+  /// Returns the class name stored in the ClassInfo.
+  const char *getClassInfoName() const;
+
   /// Creates the __vtblZ symbol lazily.
   llvm::GlobalVariable *getVtblSymbol(bool define = false);
 
@@ -89,8 +89,10 @@ LLGlobalVariable *IrClass::getVtblSymbol(bool define) {
 
   if (define) {
     auto init = getVtblInit(); // might define vtbl
-    if (!vtbl->hasInitializer())
+    if (!vtbl->hasInitializer()) {
       defineGlobal(vtbl, init, aggrdecl);
+      addVtblTypeMetadata(aggrdecl->isClassDeclaration(), vtbl);
+    }
   }
 
   return vtbl;
@@ -147,6 +149,14 @@ LLGlobalVariable *IrClass::getClassInfoSymbol(bool define) {
   return typeInfo;
 }
 
+const char *IrClass::getClassInfoName() const {
+  const char *name = aggrdecl->ident->toChars();
+  if (strncmp(name, "TypeInfo_", 9) != 0) {
+    name = aggrdecl->toPrettyChars(/*QualifyTypes=*/true);
+  }
+  return name;
+}
+
 //////////////////////////////////////////////////////////////////////////////
 
 static Type *getInterfacesArrayType() {
@@ -371,10 +381,7 @@ LLConstant *IrClass::getClassInfoInit() {
   }
 
   // string name
-  const char *name = cd->ident->toChars();
-  if (strncmp(name, "TypeInfo_", 9) != 0) {
-    name = cd->toPrettyChars(/*QualifyTypes=*/true);
-  }
+  const char *name = getClassInfoName();
   b.push_string(name);
 
   // void*[] vtbl
@@ -13,7 +13,9 @@
 
 #pragma once
 
+#include <cstdint>
 #include <list>
+#include <vector>
 
 class FuncDeclaration;
 class VarDeclaration;
@@ -44,6 +46,22 @@ struct IrModule {
   GatesList sharedGates;
   FuncDeclList unitTests;
   llvm::Function *coverageCtor = nullptr;
+  // -cov-increment=sharded: thread-local line counters
+  llvm::GlobalVariable *coverageTlsData = nullptr;
+  // -cov-increment=sharded and -cov-edges: the function adding the pending
+  // counts to _d_cover_data, registered with druntime by the coverage ctor
+  // (run before the report, and at each thread exit for thread-local counts)
+  llvm::Function *coverageMerge = nullptr;
+  // -cov-edges: the edge counters and the coefficients of the line counts
+  // in terms of them
+  struct CoverageEdgeLine {
+    unsigned counter;
+    unsigned line;
+    int32_t coefficient;
+  };
+  llvm::GlobalVariable *coverageEdges = nullptr;
+  unsigned coverageEdgesCount = 0;
+  std::vector<CoverageEdgeLine> coverageEdgeLines;
 
   llvm::DIModule *diModule = nullptr;
 
@@ -65,11 +65,16 @@ llvm::Function *createBindFunc(llvm::Module &module, llvm::Function &srcFunc,
 
 llvm::Value *
 allocParam(llvm::IRBuilder<> &builder, llvm::Type &srcType,
-           const llvm::DataLayout &layout, const ParamSlice &param,
+           llvm::Type *pointeeType, const llvm::DataLayout &layout,
+           const ParamSlice &param,
            llvm::function_ref<void(const std::string &)> errHandler,
            const BindOverride &override) {
   if (param.type == ParamType::Aggregate && srcType.isPointerTy()) {
-    auto elemType = srcType.getPointerElementType();
+    // Pointers are opaque, use the byval type if there is one and treat
+    // the payload as raw bytes otherwise.
+    auto elemType = pointeeType != nullptr
+                        ? pointeeType
+                        : llvm::ArrayType::get(builder.getInt8Ty(), param.size);
     auto stackArg = builder.CreateAlloca(elemType);
     stackArg->setAlignment(layout.getABITypeAlign(elemType));
     auto init =
@@ -82,7 +87,7 @@ allocParam(llvm::IRBuilder<> &builder, llvm::Type &srcType,
   auto init =
       parseInitializer(layout, srcType, param.data, errHandler, override);
   builder.CreateStore(init, stackArg);
-  return builder.CreateLoad(stackArg);
+  return builder.CreateLoad(&srcType, stackArg);
 }
 
 void doBind(llvm::Module &module, llvm::Function &dstFunc,
@@ -105,8 +110,10 @@ void doBind(llvm::Module &module, llvm::Function &dstFunc,
       arg = currentArg;
       ++currentArg;
     } else {
-      auto type = funcType->getParamType(static_cast<unsigned>(i));
-      arg = allocParam(builder, *type, layout, param, errHandler, override);
+      const auto argNo = static_cast<unsigned>(i);
+      auto type = funcType->getParamType(argNo);
+      arg = allocParam(builder, *type, srcFunc.getParamByValType(argNo),
+                       layout, param, errHandler, override);
     }
     assert(arg != nullptr);
     args.push_back(arg);
@@ -114,12 +121,11 @@ void doBind(llvm::Module &module, llvm::Function &dstFunc,
   assert(currentArg == dstFunc.arg_end());
 
   auto ret = builder.CreateCall(&srcFunc, args);
-  if (!srcFunc.isDeclaration()) {
-    ret->addAttribute(llvm::AttributeList::FunctionIndex,
-                      llvm::Attribute::AlwaysInline);
-  }
   ret->setCallingConv(srcFunc.getCallingConv());
   ret->setAttributes(srcFunc.getAttributes());
+  if (!srcFunc.isDeclaration()) {
+    ret->addFnAttr(llvm::Attribute::AlwaysInline);
+  }
   if (dstFunc.getReturnType()->isVoidTy()) {
     builder.CreateRetVoid();
   } else {
@@ -13,12 +13,14 @@
 //===----------------------------------------------------------------------===//
 
 #include <cassert>
+#include <chrono>
 #include <map>
 #include <memory>
 #include <sstream>
 #include <stdexcept>
 #include <type_traits>
 #include <unordered_map>
+#include <unordered_set>
 
 #include "bind.h"
 #include "callback_ostream.h"
@@ -28,13 +30,17 @@
 #include "options.h"
 #include "utils.h"
 
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/Bitcode/BitcodeReader.h"
-#include "llvm/ExecutionEngine/JITSymbol.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/Config/llvm-config.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/GlobalVariable.h"
 #include "llvm/IR/Mangler.h"
 #include "llvm/Linker/Linker.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/raw_sha1_ostream.h"
 #include "llvm/Transforms/Utils/Cloning.h"
 
 namespace {
@@ -45,6 +51,7 @@ struct RtCompileFuncList {
   const char *name;
   void **func;
   void *originalFunc;
+  void *staticFunc;
 };
 
 struct RtCompileSymList {
@@ -92,6 +99,22 @@ void enumModules(const RtCompileModuleList *modlist_head,
   }
 }
 
+// Adds the time spent in its scope to a statistics field.
+class StageTimer final {
+  uint64_t &time;
+  const std::chrono::steady_clock::time_point start;
+
+public:
+  explicit StageTimer(uint64_t &t)
+      : time(t), start(std::chrono::steady_clock::now()) {}
+  ~StageTimer() {
+    time += static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start)
+            .count());
+  }
+};
+
 std::string decorate(llvm::StringRef name, const llvm::DataLayout &datalayout) {
   assert(!name.empty());
   llvm::SmallVector<char, 64> ret;
@@ -106,6 +129,10 @@ private:
     llvm::StringRef name;
     void **thunkVar;
     void *originalFunc;
+    void *staticFunc;
+    const RtCompileModuleList *module;
+    // Resolved by a previous compilation.
+    bool compiled;
   };
   std::vector<Func> funcs;
   mutable std::unordered_map<const void *, const Func *> funcsMap;
@@ -113,6 +140,8 @@ private:
   struct BindHandle final {
     std::string name;
     void *handle = nullptr;
+    uint64_t bindId = 0;
+    std::string bindKey;
   };
   std::vector<BindHandle> bindHandles;
 
@@ -122,13 +151,21 @@ public:
     enumModules(modlist_head, context, [&](const RtCompileModuleList &current) {
       for (auto &&fun : toArray(current.funcList, static_cast<std::size_t>(
                                                       current.funcListSize))) {
-        funcs.push_back({fun.name, fun.func, fun.originalFunc});
+        funcs.push_back({fun.name, fun.func, fun.originalFunc, fun.staticFunc,
+                         &current, false});
       }
     });
   }
 
   const std::vector<Func> &functions() const { return funcs; }
 
+  /// Marks the functions of the already compiled modules.
+  template <typename P> void markCompiled(P &&isCompiled) {
+    for (auto &&fun : funcs) {
+      fun.compiled = isCompiled(fun.module);
+    }
+  }
+
   const std::unordered_map<const void *, const Func *> &functionsMap() const {
     if (funcsMap.empty() && !funcs.empty()) {
       for (auto &&fun : funcs) {
@@ -150,44 +187,83 @@ public:
 
   const std::vector<BindHandle> &getBindHandles() const { return bindHandles; }
 
-  void addBindHandle(llvm::StringRef name, void *handle) {
+  void addBindHandle(llvm::StringRef name, void *handle, uint64_t bindId,
+                     std::string bindKey) {
     assert(!name.empty());
     assert(handle != nullptr);
     BindHandle h;
     h.name = name.str();
     h.handle = handle;
+    h.bindId = bindId;
+    h.bindKey = std::move(bindKey);
     bindHandles.emplace_back(std::move(h));
   }
 };
 
-void *resolveSymbol(llvm::JITSymbol &symbol) {
-  auto addr = symbol.getAddress();
-  if (!addr) {
-    consumeError(addr.takeError());
-    return nullptr;
-  } else {
-    return reinterpret_cast<void *>(addr.get());
+// Identifies a bind specialization: the bound function and the raw bytes of
+// the bound parameters.
+std::string getBindKey(const void *originalFunc, const void *exampleFunc,
+                       llvm::ArrayRef<ParamSlice> params) {
+  std::string ret;
+  auto append = [&](const void *data, size_t size) {
+    ret.append(static_cast<const char *>(data), size);
+  };
+  append(&originalFunc, sizeof(originalFunc));
+  append(&exampleFunc, sizeof(exampleFunc));
+  for (auto &&param : params) {
+    // Placeholders have no data
+    const char bound = nullptr != param.data ? 1 : 0;
+    append(&bound, sizeof(bound));
+    append(&param.type, sizeof(param.type));
+    append(&param.size, sizeof(param.size));
+    if (bound) {
+      append(param.data, param.size);
+    }
   }
+  return ret;
 }
 
+// Specializations in compiledBinds already exist, the binds using them aren't
+// generated again.
 void generateBind(const Context &context, DynamicCompilerContext &jitContext,
-                  JitModuleInfo &moduleInfo, llvm::Module &module) {
+                  JitModuleInfo &moduleInfo, llvm::Module &module,
+                  const std::unordered_map<std::string, void *> &compiledBinds) {
+  // With incremental compilation only some of the modules are available.
   auto getIrFunc = [&](const void *ptr) -> llvm::Function * {
     assert(ptr != nullptr);
     auto funcDesc = moduleInfo.getFunc(ptr);
     if (funcDesc == nullptr) {
       return nullptr;
     }
-    return module.getFunction(funcDesc->name);
+    auto func = module.getFunction(funcDesc->name);
+    if (nullptr == func || func->isDeclaration()) {
+      return nullptr;
+    }
+    return func;
   };
 
   std::unordered_map<const void *, llvm::Function *> bindFuncs;
   bindFuncs.reserve(jitContext.getBindInstances().size() * 2);
+  // Binds of the same function with the same parameter values share one
+  // specialization.
+  std::unordered_map<std::string, llvm::Function *> specializations;
 
-  auto genBind = [&](void *bindPtr, void *originalFunc, void *exampleFunc,
+  auto genBind = [&](void *bindPtr, uint64_t bindId, void *originalFunc,
+                     void *exampleFunc,
                      const llvm::ArrayRef<ParamSlice> &params) {
     assert(bindPtr != nullptr);
     assert(bindFuncs.end() == bindFuncs.find(bindPtr));
+    auto specKey = getBindKey(originalFunc, exampleFunc, params);
+    if (compiledBinds.count(specKey) != 0) {
+      return;
+    }
+    auto specIt = specializations.find(specKey);
+    if (specializations.end() != specIt) {
+      moduleInfo.addBindHandle(specIt->second->getName(), bindPtr, bindId,
+                               std::move(specKey));
+      bindFuncs.insert({bindPtr, specIt->second});
+      return;
+    }
     auto funcToInline = getIrFunc(originalFunc);
     if (funcToInline == nullptr) {
         fatal(context, "Bind: function body not available");
@@ -198,34 +274,25 @@ void generateBind(const Context &context, DynamicCompilerContext &jitContext,
     auto overrideHandler = [&](llvm::Type &type, const void *data,
                                size_t size) -> llvm::Constant * {
       if (type.isPointerTy()) {
-        auto getBindFunc = [&]() {
-          auto handle = *static_cast<void *const *>(data);
-          return handle != nullptr && jitContext.hasBindFunction(handle)
-                     ? handle
-                     : nullptr;
-        };
-
-        auto elemType = type.getPointerElementType();
-        if (elemType->isFunctionTy()) {
-          (void)size;
-          assert(size == sizeof(void *));
-          auto val = *reinterpret_cast<void *const *>(data);
-          if (val != nullptr) {
-            auto ret = getIrFunc(val);
-            if (ret != nullptr && ret->getType() != &type) {
-              return llvm::ConstantExpr::getBitCast(ret, &type);
-            }
-            return ret;
-          }
-        } else if (auto handle = getBindFunc()) {
-          auto it = bindFuncs.find(handle);
-          assert(bindFuncs.end() != it);
+        (void)size;
+        assert(size == sizeof(void *));
+        auto val = *static_cast<void *const *>(data);
+        if (val == nullptr) {
+          return nullptr;
+        }
+        // Pointers are opaque, so check whether the value is a known jit
+        // function or a bind handle.
+        if (auto ret = getIrFunc(val)) {
+          return ret;
+        }
+        // Binds compiled before are called through their handle.
+        auto it = bindFuncs.find(val);
+        if (bindFuncs.end() != it && jitContext.hasBindFunction(val)) {
           auto bindIrFunc = it->second;
-          auto funcPtrType = bindIrFunc->getType();
-          auto globalVar1 = new llvm::GlobalVariable(
-              module, funcPtrType, true, llvm::GlobalValue::PrivateLinkage,
-              bindIrFunc, ".jit_bind_handle");
-          return llvm::ConstantExpr::getBitCast(globalVar1, &type);
+          return new llvm::GlobalVariable(
+              module, bindIrFunc->getType(), true,
+              llvm::GlobalValue::PrivateLinkage, bindIrFunc,
+              ".jit_bind_handle");
         }
       }
       return nullptr;
@@ -233,32 +300,84 @@ void generateBind(const Context &context, DynamicCompilerContext &jitContext,
     auto func =
         bindParamsToFunc(module, *funcToInline, *exampleIrFunc, params,
                          errhandler, BindOverride(overrideHandler));
-    moduleInfo.addBindHandle(func->getName(), bindPtr);
+    moduleInfo.addBindHandle(func->getName(), bindPtr, bindId, specKey);
     bindFuncs.insert({bindPtr, func});
+    specializations.insert({std::move(specKey), func});
+    ++jitContext.getStats().bindsCount;
   };
   for (auto &&bind : jitContext.getBindInstances()) {
     auto bindPtr = bind.first;
     auto &bindDesc = bind.second;
     assert(bindDesc.originalFunc != nullptr);
-    genBind(bindPtr, bindDesc.originalFunc, bindDesc.exampleFunc,
+    genBind(bindPtr, bindDesc.id, bindDesc.originalFunc, bindDesc.exampleFunc,
             bindDesc.params);
   }
 }
 
-void applyBind(const Context &context, DynamicCompilerContext &jitContext,
-               const JitModuleInfo &moduleInfo) {
+// With newBindsOnly only bind handles which don't point to code yet are
+// updated, the others may have been switched to optimized code already.
+// The addresses of the bind specializations are recorded in `compiled`.
+void resolveSymbols(const Context &context, DynamicCompilerContext &jitContext,
+                    const JitModuleInfo &moduleInfo,
+                    llvm::raw_ostream *asmListener, CompiledCode &compiled,
+                    bool newBindsOnly = false) {
+  struct Target final {
+    llvm::StringRef name;
+    void **ptr;
+    uint64_t bindId;
+    const std::string *bindKey;
+  };
   auto &layout = jitContext.getDataLayout();
+  std::vector<std::string> names;
+  std::vector<Target> targets;
+  if (jitContext.isMainContext() && !newBindsOnly) {
+    for (auto &&fun : moduleInfo.functions()) {
+      if (fun.thunkVar != nullptr && !fun.compiled) {
+        names.push_back(decorate(fun.name, layout));
+        targets.push_back({fun.name, fun.thunkVar, 0, nullptr});
+      }
+    }
+  }
+  const auto funcsCount = names.size();
   for (auto &elem : moduleInfo.getBindHandles()) {
-    auto decorated = decorate(elem.name, layout);
-    auto symbol = jitContext.findSymbol(decorated);
-    auto addr = resolveSymbol(symbol);
+    names.push_back(decorate(elem.name, layout));
+    targets.push_back({elem.name, static_cast<void **>(elem.handle),
+                       elem.bindId, &elem.bindKey});
+  }
+
+  // Look up everything at once, so independent parts can be compiled in
+  // parallel.
+  auto addrs = jitContext.lookup(names, asmListener);
+  if (!addrs) {
+    fatal(context,
+          "Can't codegen module: " + llvm::toString(addrs.takeError()));
+    return;
+  }
+
+  interruptPoint(context, "Resolve functions");
+  for (size_t i = 0; i < names.size(); ++i) {
+    if (i == funcsCount) {
+      interruptPoint(context, "Update bind handles");
+    }
+    auto &target = targets[i];
+    auto addr = (*addrs)[i];
     if (nullptr == addr) {
       std::string desc = std::string("Symbol not found in jitted code: \"") +
-                         elem.name + "\" (\"" + decorated + "\")";
+                         target.name.str() + "\" (\"" + names[i] + "\")";
       fatal(context, desc);
+    } else if (i < funcsCount) {
+      storeFunctionPointer(target.ptr, addr);
     } else {
-      auto handle = static_cast<void **>(elem.handle);
-      *handle = addr;
+      jitContext.updateBindHandle(target.ptr, target.bindId, addr,
+                                  newBindsOnly);
+      compiled.binds[*target.bindKey] = addr;
+    }
+
+    if (i < funcsCount && nullptr != context.interruptPointHandler) {
+      std::stringstream ss;
+      ss << target.name.data() << " to " << addr;
+      auto str = ss.str();
+      interruptPoint(context, "Resolved", str.c_str());
     }
   }
 }
@@ -306,19 +425,400 @@ void setFunctionsTarget(llvm::Module &module, const llvm::TargetMachine &TM) {
   }
 }
 
+// Hash of the settings that influence the generated code.
+std::string getSettingsKey(DynamicCompilerContext &jitContext,
+                           const JitSettings &settings) {
+  auto &tm = jitContext.getTargetMachine();
+  llvm::raw_sha1_ostream os;
+  os << LLVM_VERSION_STRING << '\0' << static_cast<int>(ApiVersion) << '\0';
+  os << tm.getTargetTriple().str() << '\0' << tm.getTargetCPU() << '\0'
+     << tm.getTargetFeatureString() << '\0';
+  os << settings.optimizer.optLevel << ' ' << settings.optimizer.sizeLevel
+     << ' ' << settings.compileThreads << ' ' << settings.lazy << ' '
+     << settings.tiered << ' ' << settings.tierUpThreshold << ' '
+     << settings.profile << ' ' << settings.profileInterval << '\0';
+  os << settings.optimizer.options.args << '\0' << getLLVMOptionsString()
+     << '\0';
+  return llvm::toHex(os.sha1(), /*LowerCase*/ true);
+}
+
+// Hash of everything that influences the generated code. The merged module
+// already includes the bind parameters and @dynamicCompileConst values.
+std::string getCodeKey(const std::string &settingsKey,
+                       const llvm::Module &module) {
+  llvm::raw_sha1_ostream os;
+  os << settingsKey << '\0';
+  llvm::WriteBitcodeToFile(module, os);
+  return llvm::toHex(os.sha1(), /*LowerCase*/ true);
+}
+
+// Raw values of the @dynamicCompileConst variables of the module, used to
+// detect changes without parsing it.
+std::string getVarValues(const RtCompileModuleList &current,
+                         llvm::ArrayRef<size_t> sizes) {
+  auto vars =
+      toArray(current.varList, static_cast<std::size_t>(current.varListSize));
+  assert(vars.size() == sizes.size());
+  std::string ret;
+  for (size_t i = 0; i < vars.size(); ++i) {
+    ret.append(static_cast<const char *>(vars[i].init), sizes[i]);
+  }
+  return ret;
+}
+
+CompiledCode::Module getModuleState(const RtCompileModuleList &current,
+                                    const llvm::Module &module) {
+  CompiledCode::Module ret;
+  ret.irData = current.irData;
+  auto &layout = module.getDataLayout();
+  for (auto &&var : toArray(current.varList, static_cast<std::size_t>(
+                                                 current.varListSize))) {
+    auto irVar = module.getGlobalVariable(var.name, /*AllowInternal*/ true);
+    ret.varSizes.push_back(
+        nullptr != irVar
+            ? static_cast<size_t>(
+                  layout.getTypeStoreSize(irVar->getValueType())
+                      .getFixedValue())
+            : 0);
+  }
+  ret.varValues = getVarValues(current, ret.varSizes);
+  return ret;
+}
+
+// Parses the module, prepares it for the host and records its state and
+// symbols.
+std::unique_ptr<llvm::Module> parseModule(const Context &context,
+                                          DynamicCompilerContext &myJit,
+                                          const RtCompileModuleList &current,
+                                          CompiledCode &compiled) {
+  StageTimer timer(myJit.getStats().parseTime);
+  ++myJit.getStats().modulesCount;
+  interruptPoint(context, "load IR");
+  auto buff = llvm::MemoryBuffer::getMemBuffer(
+      llvm::StringRef(current.irData,
+                      static_cast<std::size_t>(current.irDataSize)),
+      "", false);
+  interruptPoint(context, "parse IR");
+  auto mod = llvm::parseBitcodeFile(*buff, myJit.getContext());
+  if (!mod) {
+    fatal(context, "Unable to parse IR: " + llvm::toString(mod.takeError()));
+    return nullptr;
+  }
+  llvm::Module &module = **mod;
+  const auto name = module.getName();
+  interruptPoint(context, "Verify module", name.data());
+  verifyModule(context, module);
+
+  dumpModule(context, module, DumpStage::OriginalModule);
+  setFunctionsTarget(module, myJit.getTargetMachine());
+
+  module.setDataLayout(myJit.getTargetMachine().createDataLayout());
+
+  interruptPoint(context, "setRtCompileVars", name.data());
+  setRtCompileVars(context, module,
+                   toArray(current.varList,
+                           static_cast<std::size_t>(current.varListSize)));
+  compiled.modules[&current] = getModuleState(current, module);
+
+  auto &layout = myJit.getDataLayout();
+  for (auto &&sym : toArray(current.symList,
+                            static_cast<std::size_t>(current.symListSize))) {
+    myJit.addSymbol(decorate(sym.name, layout), sym.sym);
+  }
+  return std::move(*mod);
+}
+
+void linkModule(const Context &context, Stats &stats,
+                std::unique_ptr<llvm::Module> &dst,
+                std::unique_ptr<llvm::Module> src) {
+  if (nullptr == src) {
+    return;
+  }
+  StageTimer timer(stats.linkTime);
+  if (nullptr == dst) {
+    dst = std::move(src);
+  } else if (llvm::Linker::linkModules(*dst, std::move(src))) {
+    fatal(context, "Can't merge module");
+  }
+}
+
 struct JitFinaliser final {
   DynamicCompilerContext &jit;
+  // The previous code is still in use after a failed incremental compilation.
+  const bool incremental;
   bool finalized = false;
-  explicit JitFinaliser(DynamicCompilerContext &j) : jit(j) {}
+  JitFinaliser(DynamicCompilerContext &j, bool inc)
+      : jit(j), incremental(inc) {}
   ~JitFinaliser() {
     if (!finalized) {
-      jit.reset();
+      if (incremental) {
+        jit.discardIncrement();
+      } else {
+        jit.reset();
+      }
     }
   }
 
   void finalze() { finalized = true; }
 };
 
+// Calls must not reach code which is about to be removed, let them use the
+// statically compiled functions until new code is available.
+void restoreStaticFunctions(DynamicCompilerContext &jitContext,
+                            const JitModuleInfo &moduleInfo) {
+  if (jitContext.isMainContext()) {
+    for (auto &&fun : moduleInfo.functions()) {
+      if (fun.thunkVar != nullptr && fun.staticFunc != nullptr) {
+        storeFunctionPointer(fun.thunkVar, fun.staticFunc);
+      }
+    }
+  }
+  jitContext.clearBindHandles();
+}
+
+// Entry points of the jitted code: @dynamicCompile functions called through
+// thunks and bind functions.
+std::vector<TieredFunction>
+getTieredFunctions(const DynamicCompilerContext &jitContext,
+                   const JitModuleInfo &moduleInfo) {
+  std::vector<TieredFunction> ret;
+  if (jitContext.isMainContext()) {
+    for (auto &&fun : moduleInfo.functions()) {
+      if (fun.thunkVar != nullptr) {
+        TieredFunction func;
+        func.name = fun.name.str();
+        func.targets.push_back({fun.thunkVar, 0});
+        ret.emplace_back(std::move(func));
+      }
+    }
+  }
+  // Binds sharing a specialization share the counter.
+  llvm::StringMap<size_t> bindFuncs;
+  for (auto &&elem : moduleInfo.getBindHandles()) {
+    auto it = bindFuncs.insert({elem.name, ret.size()});
+    if (it.second) {
+      TieredFunction func;
+      func.name = elem.name;
+      ret.emplace_back(std::move(func));
+    }
+    ret[it.first->second].targets.push_back(
+        {static_cast<void **>(elem.handle), elem.bindId});
+  }
+  return ret;
+}
+
+void compileModule(const Context &context, DynamicCompilerContext &myJit,
+                   const JitModuleInfo &moduleInfo,
+                   std::unique_ptr<llvm::Module> finalModule,
+                   const JitSettings &settings, CompiledCode compiled) {
+  JitFinaliser jitFinalizer(myJit, settings.incremental);
+  if (settings.tiered || settings.profile) {
+    interruptPoint(context, "Add tier up counters");
+    myJit.prepareTiering(*finalModule,
+                         getTieredFunctions(myJit, moduleInfo), settings);
+  }
+
+  auto &stats = myJit.getStats();
+  bool cached = false;
+  if (!settings.cacheKey.empty()) {
+    StageTimer timer(stats.codegenTime);
+    interruptPoint(context, "Load cached objects");
+    auto loaded = myJit.addCachedObjects(*finalModule, settings);
+    if (!loaded) {
+      fatal(context, "Can't load cached objects: " +
+                         llvm::toString(loaded.takeError()));
+    } else {
+      cached = *loaded;
+    }
+  }
+
+  if (!cached) {
+    if (!settings.lazy) {
+      StageTimer timer(stats.optimizeTime);
+      interruptPoint(context, "Optimize final module");
+      auto optimizer = settings.optimizer;
+      if (settings.tiered) {
+        // The baseline tier isn't optimized
+        optimizer.optLevel = 0;
+        optimizer.sizeLevel = 0;
+      }
+      optimizeModule(context, myJit.getTargetMachine(), optimizer,
+                     *finalModule);
+    }
+
+    interruptPoint(context, "Verify final module");
+    verifyModule(context, *finalModule);
+
+    dumpModule(context, *finalModule, DumpStage::OptimizedModule);
+
+    StageTimer timer(stats.codegenTime);
+    interruptPoint(context, "Codegen final module");
+    if (auto err = myJit.addModule(std::move(finalModule), settings)) {
+      fatal(context,
+            "Can't codegen module: " + llvm::toString(std::move(err)));
+    }
+  }
+
+  {
+    // Eagerly compiled code is generated by the lookup
+    StageTimer timer(stats.codegenTime);
+    if (nullptr != context.dumpHandler) {
+      auto callback = [&](const char *str, size_t len) {
+        context.dumpHandler(context.dumpHandlerData, DumpStage::FinalAsm, str,
+                            len);
+      };
+
+      CallbackOstream os(callback);
+      resolveSymbols(context, myJit, moduleInfo, &os, compiled);
+      os.flush();
+    } else {
+      resolveSymbols(context, myJit, moduleInfo, nullptr, compiled);
+    }
+  }
+  if (settings.tiered || settings.profile) {
+    myJit.startTiering();
+  }
+  myJit.setCompiledCode(std::move(compiled));
+  myJit.finishStats();
+  jitFinalizer.finalze();
+}
+
+// Compiles the module on the calling thread or in the background.
+void compileCode(const Context &context, DynamicCompilerContext &myJit,
+                 JitModuleInfo moduleInfo, std::unique_ptr<llvm::Module> module,
+                 JitSettings settings, CompiledCode compiled, bool async) {
+  if (!async) {
+    compileModule(context, myJit, moduleInfo, std::move(module), settings,
+                  std::move(compiled));
+    return;
+  }
+
+  // Optimization and codegen don't touch user data, so only they run in the
+  // background. The handlers may refer to the caller's stack, so they aren't
+  // used there.
+  Context taskContext = context;
+  taskContext.interruptPointHandler = nullptr;
+  taskContext.interruptPointHandlerData = nullptr;
+  taskContext.objectCacheDir = {0, nullptr};
+  myJit.runInBackground([&myJit, taskContext, info = std::move(moduleInfo),
+                         module = std::move(module),
+                         settings = std::move(settings),
+                         compiled = std::move(compiled)]() mutable {
+    compileModule(taskContext, myJit, info, std::move(module), settings,
+                  std::move(compiled));
+  });
+}
+
+// Adds the modules and bind specializations which are new since the last
+// compilation as a separate dylib, the existing code stays in place.
+// Returns false if it can't be kept, i.e. if modules were removed or the
+// @dynamicCompileConst values of a module changed, as other modules may have
+// inlined its code.
+bool compileIncrement(const Context &context, DynamicCompilerContext &myJit,
+                      const RtCompileModuleList *modlist_head,
+                      JitModuleInfo &moduleInfo, JitSettings settings,
+                      bool async) {
+  const auto &previous = myJit.getCompiledCode();
+  if (previous.modules.empty()) {
+    return false;
+  }
+
+  std::unordered_set<const RtCompileModuleList *> newModules;
+  size_t compiledModules = 0;
+  bool changed = false;
+  enumModules(modlist_head, context, [&](const RtCompileModuleList &current) {
+    auto it = previous.modules.find(&current);
+    if (previous.modules.end() == it) {
+      newModules.insert(&current);
+      return;
+    }
+    ++compiledModules;
+    changed = changed || it->second.irData != current.irData ||
+              it->second.varValues !=
+                  getVarValues(current, it->second.varSizes);
+  });
+  if (changed || compiledModules != previous.modules.size()) {
+    return false;
+  }
+  // Other contexts only use the code through binds.
+  if (!myJit.isMainContext()) {
+    newModules.clear();
+  }
+
+  // Binds sharing a compiled specialization only need their handle updated,
+  // the others need the modules of their functions.
+  std::unordered_set<const RtCompileModuleList *> bindModules;
+  for (auto &&bind : myJit.getBindInstances()) {
+    auto &bindDesc = bind.second;
+    auto it = previous.binds.find(getBindKey(
+        bindDesc.originalFunc, bindDesc.exampleFunc, bindDesc.params));
+    if (previous.binds.end() != it) {
+      myJit.updateBindHandle(bind.first, bindDesc.id, it->second,
+                             /*onlyIfUnset*/ true);
+      continue;
+    }
+    auto original = moduleInfo.getFunc(bindDesc.originalFunc);
+    auto example = moduleInfo.getFunc(bindDesc.exampleFunc);
+    if (nullptr == original || nullptr == example) {
+      // Reported by the full compilation
+      return false;
+    }
+    bindModules.insert(original->module);
+    bindModules.insert(example->module);
+  }
+  if (newModules.empty() && bindModules.empty()) {
+    // Nothing new, only binds sharing an existing specialization may have
+    // needed their handles updated.
+    interruptPoint(context, "Reuse compiled code");
+    myJit.finishStats();
+    return true;
+  }
+
+  interruptPoint(context, "Compile increment");
+  CompiledCode compiled = previous;
+  // The code doesn't correspond to a single module anymore
+  compiled.codeKey.clear();
+  std::unique_ptr<llvm::Module> increment;
+  std::vector<std::string> inlineOnly;
+  enumModules(modlist_head, context, [&](const RtCompileModuleList &current) {
+    const bool isNew = newModules.count(&current) != 0;
+    if (!isNew && bindModules.count(&current) == 0) {
+      return;
+    }
+    auto module = parseModule(context, myJit, current, compiled);
+    if (!isNew && nullptr != module) {
+      // The code is compiled already, it is only needed for the binds.
+      for (auto &&value : module->global_values()) {
+        if (!value.isDeclaration() && !value.hasLocalLinkage()) {
+          inlineOnly.push_back(value.getName().str());
+        }
+      }
+    }
+    linkModule(context, myJit.getStats(), increment, std::move(module));
+  });
+  assert(nullptr != increment);
+  moduleInfo.markCompiled([&](const RtCompileModuleList *module) {
+    return newModules.count(module) == 0;
+  });
+
+  {
+    StageTimer timer(myJit.getStats().bindTime);
+    interruptPoint(context, "Generate bind functions");
+    generateBind(context, myJit, moduleInfo, *increment, previous.binds);
+  }
+  for (auto &&name : inlineOnly) {
+    if (auto value = increment->getNamedValue(name)) {
+      makeInlineOnly(*value, myJit.getSymbols(), myJit.getDataLayout());
+    }
+  }
+
+  settings.incremental = true;
+  settings.cacheKey.clear();
+  compileCode(context, myJit, std::move(moduleInfo), std::move(increment),
+              std::move(settings), std::move(compiled), async);
+  return true;
+}
+
 void rtCompileProcessImplSoInternal(const RtCompileModuleList *modlist_head,
                                     const Context &context) {
   if (nullptr == modlist_head) {
@@ -327,114 +827,91 @@ void rtCompileProcessImplSoInternal(const RtCompileModuleList *modlist_head,
   }
   interruptPoint(context, "Init");
   DynamicCompilerContext &myJit = getJit(context.compilerContext);
+  // The code of a previous asynchronous call may still be compiling.
+  myJit.waitForBackgroundTask();
+  myJit.startStats();
+  myJit.setRegistration(context.debuggerRegistration, context.perfMap);
 
   JitModuleInfo moduleInfo(context, modlist_head);
+  myJit.resetContext();
+
+  // Dumps need the whole module to be available at once and must be reported
+  // before returning.
+  const bool async =
+      context.asyncCompilation && nullptr == context.dumpHandler;
+  JitSettings settings;
+  settings.optimizer.optLevel = context.optLevel;
+  settings.optimizer.sizeLevel = context.sizeLevel;
+  settings.optimizer.options = myJit.getOptions();
+  settings.compileThreads = context.compileThreads;
+  // Dumps show the fully optimized code
+  settings.tiered = context.tieredCompilation && context.tierUpThreshold > 0 &&
+                    nullptr == context.dumpHandler;
+  settings.tierUpThreshold = context.tierUpThreshold;
+  settings.profile = context.profileGuided && nullptr == context.dumpHandler;
+  settings.profileInterval = context.profileInterval;
+  settings.lazy = context.lazyCompilation && nullptr == context.dumpHandler &&
+                  !async && !settings.tiered && !settings.profile;
+  // Lazily compiled code isn't cached, dumps need the actual compilation
+  if (context.objectCacheDir.len > 0 && !settings.lazy &&
+      nullptr == context.dumpHandler) {
+    settings.cacheDir.assign(context.objectCacheDir.data,
+                             context.objectCacheDir.len);
+  }
+  auto settingsKey = getSettingsKey(myJit, settings);
+
+  // Tier up and profile counters are only added to a whole module.
+  if (nullptr == context.dumpHandler && !settings.tiered &&
+      !settings.profile &&
+      settingsKey == myJit.getCompiledCode().settingsKey &&
+      compileIncrement(context, myJit, modlist_head, moduleInfo, settings,
+                       async)) {
+    return;
+  }
+
+  CompiledCode compiled;
   std::unique_ptr<llvm::Module> finalModule;
   myJit.clearSymMap();
-  auto &layout = myJit.getDataLayout();
-  OptimizerSettings settings;
-  settings.optLevel = context.optLevel;
-  settings.sizeLevel = context.sizeLevel;
   enumModules(modlist_head, context, [&](const RtCompileModuleList &current) {
-    interruptPoint(context, "load IR");
-    auto buff = llvm::MemoryBuffer::getMemBuffer(
-        llvm::StringRef(current.irData,
-                        static_cast<std::size_t>(current.irDataSize)),
-        "", false);
-    interruptPoint(context, "parse IR");
-    auto mod = llvm::parseBitcodeFile(*buff, myJit.getContext());
-    if (!mod) {
-      fatal(context, "Unable to parse IR: " + llvm::toString(mod.takeError()));
-    } else {
-      llvm::Module &module = **mod;
-      const auto name = module.getName();
-      interruptPoint(context, "Verify module", name.data());
-      verifyModule(context, module);
-
-      dumpModule(context, module, DumpStage::OriginalModule);
-      setFunctionsTarget(module, myJit.getTargetMachine());
-
-      module.setDataLayout(myJit.getTargetMachine().createDataLayout());
-
-      interruptPoint(context, "setRtCompileVars", name.data());
-      setRtCompileVars(context, module,
-                       toArray(current.varList,
-                               static_cast<std::size_t>(current.varListSize)));
-
-      if (nullptr == finalModule) {
-        finalModule = std::move(*mod);
-      } else {
-        if (llvm::Linker::linkModules(*finalModule, std::move(*mod))) {
-          fatal(context, "Can't merge module");
-        }
-      }
-
-      for (auto &&sym : toArray(current.symList, static_cast<std::size_t>(
-                                                     current.symListSize))) {
-        myJit.addSymbol(decorate(sym.name, layout), sym.sym);
-      }
-    }
+    linkModule(context, myJit.getStats(), finalModule,
+               parseModule(context, myJit, current, compiled));
   });
 
   assert(nullptr != finalModule);
 
-  interruptPoint(context, "Generate bind functions");
-  generateBind(context, myJit, moduleInfo, *finalModule);
+  {
+    StageTimer timer(myJit.getStats().bindTime);
+    interruptPoint(context, "Generate bind functions");
+    generateBind(context, myJit, moduleInfo, *finalModule, {});
+  }
   dumpModule(context, *finalModule, DumpStage::MergedModule);
-  interruptPoint(context, "Optimize final module");
-  optimizeModule(context, myJit.getTargetMachine(), settings, *finalModule);
-
-  interruptPoint(context, "Verify final module");
-  verifyModule(context, *finalModule);
 
-  dumpModule(context, *finalModule, DumpStage::OptimizedModule);
-
-  interruptPoint(context, "Codegen final module");
-  if (nullptr != context.dumpHandler) {
-    auto callback = [&](const char *str, size_t len) {
-      context.dumpHandler(context.dumpHandlerData, DumpStage::FinalAsm, str,
-                          len);
-    };
-
-    CallbackOstream os(callback);
-    if (auto err = myJit.addModule(std::move(finalModule), &os)) {
-      fatal(context, "Can't codegen module: " + llvm::toString(std::move(err)));
+  // Dumps need the actual compilation, so their code isn't reused either.
+  if (nullptr == context.dumpHandler) {
+    interruptPoint(context, "Hash final module");
+    compiled.codeKey = getCodeKey(settingsKey, *finalModule);
+    compiled.settingsKey = std::move(settingsKey);
+    if (compiled.codeKey == myJit.getCompiledCode().codeKey) {
+      // Nothing changed since the last compilation, only binds sharing an
+      // existing specialization may need their handles updated.
+      interruptPoint(context, "Reuse compiled code");
+      compiled.binds = myJit.getCompiledCode().binds;
+      resolveSymbols(context, myJit, moduleInfo, nullptr, compiled,
+                     /*newBindsOnly*/ true);
+      myJit.setCompiledCode(std::move(compiled));
+      myJit.finishStats();
+      return;
     }
-  } else {
-    if (auto err = myJit.addModule(std::move(finalModule), nullptr)) {
-      fatal(context, "Can't codegen module: " + llvm::toString(std::move(err)));
+    if (!settings.cacheDir.empty()) {
+      settings.cacheKey = compiled.codeKey;
     }
   }
 
-  JitFinaliser jitFinalizer(myJit);
-  if (myJit.isMainContext()) {
-    interruptPoint(context, "Resolve functions");
-    for (auto &&fun : moduleInfo.functions()) {
-      if (fun.thunkVar == nullptr) {
-        continue;
-      }
-      auto decorated = decorate(fun.name, layout);
-      auto symbol = myJit.findSymbol(decorated);
-      auto addr = resolveSymbol(symbol);
-      if (nullptr == addr) {
-        std::string desc = std::string("Symbol not found in jitted code: \"") +
-                           fun.name.data() + "\" (\"" + decorated + "\")";
-        fatal(context, desc);
-      } else {
-        *fun.thunkVar = addr;
-      }
+  restoreStaticFunctions(myJit, moduleInfo);
+  myJit.reset();
 
-      if (nullptr != context.interruptPointHandler) {
-        std::stringstream ss;
-        ss << fun.name.data() << " to " << addr;
-        auto str = ss.str();
-        interruptPoint(context, "Resolved", str.c_str());
-      }
-    }
-  }
-  interruptPoint(context, "Update bind handles");
-  applyBind(context, myJit, moduleInfo);
-  jitFinalizer.finalze();
+  compileCode(context, myJit, std::move(moduleInfo), std::move(finalModule),
+              std::move(settings), std::move(compiled), async);
 }
 
 } // anon namespace
@@ -476,10 +953,43 @@ EXTERNAL void JIT_DESTROY_COMPILER_CONTEXT(DynamicCompilerContext *context) {
   delete context;
 }
 
-EXTERNAL bool JIT_SET_OPTS(const Slice<Slice<const char>> *args,
+EXTERNAL void JIT_WAIT_FOR_CODE(DynamicCompilerContext *context) {
+  getJit(context).waitForBackgroundTask();
+}
+
+EXTERNAL void JIT_GET_STATS(class DynamicCompilerContext *context,
+                            Stats *stats, size_t statsSize) {
+  assert(nullptr != stats);
+  assert(sizeof(*stats) == statsSize);
+  DynamicCompilerContext &myJit = getJit(context);
+  myJit.waitForBackgroundTask();
+  *stats = myJit.getStats();
+}
+
+EXTERNAL bool JIT_SET_OPTS(class DynamicCompilerContext *context,
+                           const Slice<Slice<const char>> *args,
                            void (*errs)(void *, const char *, size_t),
                            void *errsContext) {
   assert(args != nullptr);
-  return parseOptions(*args, errs, errsContext);
+  if (nullptr == context) {
+    // Compilations of the main context use the global options, LLVM options
+    // are global anyway.
+    getJit(nullptr).waitForBackgroundTask();
+    JitOptions options;
+    if (!parseOptions(*args, errs, errsContext, options,
+                      /*allowLLVMOptions*/ true)) {
+      return false;
+    }
+    setGlobalOptions(std::move(options));
+    return true;
+  }
+  context->waitForBackgroundTask();
+  JitOptions options;
+  if (!parseOptions(*args, errs, errsContext, options,
+                    /*allowLLVMOptions*/ false)) {
+    return false;
+  }
+  context->setOptions(std::move(options));
+  return true;
 }
 }
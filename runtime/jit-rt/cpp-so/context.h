@@ -49,6 +49,8 @@ enum { ApiVersion = LDC_DYNAMIC_COMPILE_API_VERSION };
 #define JIT_DESTROY_COMPILER_CONTEXT                                           \
   MAKE_JIT_API_CALL(destroyDynamicCompilerContextSo)
 #define JIT_SET_OPTS MAKE_JIT_API_CALL(setDynamicCompilerOptsImpl)
+#define JIT_WAIT_FOR_CODE MAKE_JIT_API_CALL(waitForDynamicCodeSo)
+#define JIT_GET_STATS MAKE_JIT_API_CALL(getDynamicCompileStatsSo)
 
 typedef void (*InterruptPointHandlerT)(void *, const char *action,
                                        const char *object);
@@ -68,4 +70,28 @@ struct Context final {
   DumpHandlerT dumpHandler = nullptr;
   void *dumpHandlerData = nullptr;
   DynamicCompilerContext *compilerContext = nullptr;
+  unsigned compileThreads = 0;
+  bool lazyCompilation = false;
+  Slice<const char> objectCacheDir = {0, nullptr};
+  bool asyncCompilation = false;
+  bool tieredCompilation = false;
+  unsigned tierUpThreshold = 0;
+  bool profileGuided = false;
+  unsigned profileInterval = 0;
+  bool debuggerRegistration = false;
+  bool perfMap = false;
+};
+
+/// Statistics of the last compilation, times are in nanoseconds.
+struct Stats final {
+  uint64_t parseTime = 0;
+  uint64_t linkTime = 0;
+  uint64_t bindTime = 0;
+  uint64_t optimizeTime = 0;
+  uint64_t codegenTime = 0;
+  uint64_t totalTime = 0;
+  uint64_t modulesCount = 0;
+  uint64_t bindsCount = 0;
+  uint64_t functionsCount = 0;
+  uint64_t codeSize = 0;
 };
@@ -248,10 +248,11 @@ void disassemble(const llvm::TargetMachine &tm,
     return;
   }
 
-  llvm::MCObjectFileInfo mofi;
-  llvm::MCContext ctx(mai, mri, &mofi);
-  mofi.InitMCObjectFileInfo(tm.getTargetTriple(), tm.isPositionIndependent(),
-                            ctx, tm.getCodeModel() == llvm::CodeModel::Large);
+  llvm::MCContext ctx(tm.getTargetTriple(), mai, mri, sti);
+  auto mofi = unique(target.createMCObjectFileInfo(
+      ctx, tm.isPositionIndependent(),
+      tm.getCodeModel() == llvm::CodeModel::Large));
+  ctx.setObjectFileInfo(mofi.get());
 
   auto disasm = unique(target.createMCDisassembler(*sti, ctx));
   if (nullptr == disasm) {
@@ -281,13 +282,20 @@ void disassemble(const llvm::TargetMachine &tm,
 
   // Streamer takes ownership of mip mab
   auto asmStreamer = unique(target.createAsmStreamer(
-      ctx, std::make_unique<llvm::formatted_raw_ostream>(os), true, true,
-      mip.release(), nullptr, std::move(mab), false));
+      ctx, std::make_unique<llvm::formatted_raw_ostream>(os),
+#if LDC_LLVM_VER < 1900
+      true, true,
+#endif
+      mip.release(), nullptr, std::move(mab)
+#if LDC_LLVM_VER < 1900
+      , false
+#endif
+      ));
   if (nullptr == asmStreamer) {
     return;
   }
 
-  asmStreamer->InitSections(false);
+  asmStreamer->initSections(false, *sti);
 
   std::unordered_map<uint64_t, std::vector<uint64_t>> sectionsToProcess;
   for (const auto &symbol : object.symbols()) {
@@ -0,0 +1,126 @@
+//===-- event_listener.cpp ------------------------------------------------===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the Boost Software License. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "event_listener.h"
+
+#include <string>
+
+#include "llvm/Object/ObjectFile.h"
+#include "llvm/Object/SymbolSize.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace {
+// The perf map is shared by all contexts, perf reads /tmp/perf-<pid>.map.
+void writePerfMap(const llvm::object::ObjectFile &obj) {
+  static std::mutex mutex;
+  static std::unique_ptr<llvm::raw_fd_ostream> os;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  if (nullptr == os) {
+    std::error_code ec;
+    auto path = "/tmp/perf-" +
+                std::to_string(llvm::sys::Process::getProcessId()) + ".map";
+    os = std::make_unique<llvm::raw_fd_ostream>(path, ec,
+                                                llvm::sys::fs::OF_Append);
+    if (ec) {
+      os.reset();
+      return;
+    }
+  }
+
+  for (auto &&symSize : llvm::object::computeSymbolSizes(obj)) {
+    auto &sym = symSize.first;
+    auto type = sym.getType();
+    auto name = sym.getName();
+    auto addr = sym.getAddress();
+    if (!type || !name || !addr ||
+        *type != llvm::object::SymbolRef::ST_Function) {
+      llvm::consumeError(type.takeError());
+      llvm::consumeError(name.takeError());
+      llvm::consumeError(addr.takeError());
+      continue;
+    }
+    os->write_hex(*addr) << ' ';
+    os->write_hex(symSize.second) << ' ' << *name << '\n';
+  }
+  os->flush();
+}
+} // anon namespace
+
+void JitEventListener::setRegistration(bool debuggerReg, bool perfMapReg) {
+  std::lock_guard<std::mutex> lock(mutex);
+  debugger = debuggerReg;
+  perfMap = perfMapReg;
+}
+
+void JitEventListener::resetCounts() {
+  codeSize = 0;
+  functionsCount = 0;
+}
+
+void JitEventListener::notifyObjectLoaded(
+    ObjectKey key, const llvm::object::ObjectFile &obj,
+    const llvm::RuntimeDyld::LoadedObjectInfo &info) {
+  for (auto &&section : obj.sections()) {
+    if (section.isText()) {
+      codeSize += section.getSize();
+    }
+  }
+  for (auto &&sym : obj.symbols()) {
+    auto type = sym.getType();
+    if (!type) {
+      llvm::consumeError(type.takeError());
+      continue;
+    }
+    auto flags = sym.getFlags();
+    if (!flags) {
+      llvm::consumeError(flags.takeError());
+      continue;
+    }
+    if (*type == llvm::object::SymbolRef::ST_Function &&
+        0 == (*flags & llvm::object::SymbolRef::SF_Undefined)) {
+      ++functionsCount;
+    }
+  }
+
+  bool registerDebugger = false;
+  bool registerPerfMap = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    registerDebugger = debugger;
+    registerPerfMap = perfMap;
+    if (registerDebugger) {
+      debuggerObjects.insert(key);
+    }
+  }
+  if (registerDebugger) {
+    llvm::JITEventListener::createGDBRegistrationListener()
+        ->notifyObjectLoaded(key, obj, info);
+  }
+  if (registerPerfMap) {
+    // Symbol addresses of the debug object are the load addresses.
+    auto debugObj = info.getObjectForDebug(obj);
+    if (nullptr != debugObj.getBinary()) {
+      writePerfMap(*debugObj.getBinary());
+    }
+  }
+}
+
+void JitEventListener::notifyFreeingObject(ObjectKey key) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (0 == debuggerObjects.erase(key)) {
+      return;
+    }
+  }
+  llvm::JITEventListener::createGDBRegistrationListener()
+      ->notifyFreeingObject(key);
+}
@@ -0,0 +1,52 @@
+//===-- event_listener.h - jit support --------------------------*- C++ -*-===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the Boost Software License. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Jit runtime - notifications about loaded objects.
+// Collects code statistics and makes the jitted functions known to debuggers
+// (GDB JIT interface) and profilers (perf map file).
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <set>
+
+#include "llvm/ExecutionEngine/JITEventListener.h"
+
+class JitEventListener final : public llvm::JITEventListener {
+public:
+  /// Applies to objects loaded from now on.
+  void setRegistration(bool debugger, bool perfMap);
+
+  /// Size of the loaded code sections and number of functions since the last
+  /// resetCounts() call.
+  uint64_t getCodeSize() const { return codeSize; }
+  uint64_t getFunctionsCount() const { return functionsCount; }
+  void resetCounts();
+
+  void notifyObjectLoaded(ObjectKey key, const llvm::object::ObjectFile &obj,
+                          const llvm::RuntimeDyld::LoadedObjectInfo &info)
+      override;
+
+  void notifyFreeingObject(ObjectKey key) override;
+
+private:
+  // Objects may be loaded on compile threads.
+  std::mutex mutex;
+  bool debugger = false;
+  bool perfMap = false;
+  // Registered with the debugger, which must be notified when they are freed.
+  std::set<ObjectKey> debuggerObjects;
+
+  std::atomic<uint64_t> codeSize{0};
+  std::atomic<uint64_t> functionsCount{0};
+};
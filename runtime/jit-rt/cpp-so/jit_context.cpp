@@ -15,16 +15,38 @@
 #include "jit_context.h"
 
 #include <cassert>
+#include <chrono>
+#include <functional>
+#include <numeric>
 
-#include "llvm/ADT/StringExtras.h"
-#include "llvm/ExecutionEngine/RuntimeDyld.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/ExecutionEngine/Orc/CompileUtils.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h"
+#include "llvm/ExecutionEngine/Orc/Mangling.h"
+#include "llvm/ExecutionEngine/Orc/ObjectTransformLayer.h"
+#include "llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h"
 #include "llvm/ExecutionEngine/SectionMemoryManager.h"
+#include "llvm/IR/Mangler.h"
 #include "llvm/IR/Module.h"
+#include "llvm/Object/ObjectFile.h"
 #include "llvm/Support/DynamicLibrary.h"
-#include "llvm/Support/Host.h"
-#include "llvm/Support/TargetRegistry.h"
 #include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
 #include "llvm/Target/TargetMachine.h"
+#if LDC_LLVM_VER >= 1700
+#include "llvm/TargetParser/Host.h"
+#else
+#include "llvm/Support/Host.h"
+#endif
+#include "llvm/Transforms/Utils/SplitModule.h"
+
+#include "disassembler.h"
+#include "profile.h"
+#include "utils.h"
 
 namespace {
 
@@ -54,91 +76,234 @@ StaticInitHelper &staticInit() {
   return obj;
 }
 
-std::unique_ptr<llvm::TargetMachine> createTargetMachine() {
+llvm::orc::JITTargetMachineBuilder createTargetMachineBuilder() {
   staticInit();
 
-  std::string triple(llvm::sys::getProcessTriple());
-  std::string error;
-  auto target = llvm::TargetRegistry::lookupTarget(triple, error);
-  assert(target != nullptr);
-  std::unique_ptr<llvm::TargetMachine> ret(target->createTargetMachine(
-      triple, llvm::sys::getHostCPUName(), llvm::join(getHostAttrs(), ","), {},
-      llvm::Optional<llvm::Reloc::Model>{},
-      llvm::Optional<llvm::CodeModel::Model>{}, llvm::CodeGenOpt::Default,
-      /*jit*/ true));
+  llvm::orc::JITTargetMachineBuilder builder(
+      llvm::Triple(llvm::sys::getProcessTriple()));
+  builder.setCPU(llvm::sys::getHostCPUName().str());
+  auto attrs = getHostAttrs();
+  builder.addFeatures(std::vector<std::string>(attrs.begin(), attrs.end()));
+  return builder;
+}
+
+std::unique_ptr<llvm::TargetMachine> createTargetMachine() {
+  auto ret = llvm::cantFail(createTargetMachineBuilder().createTargetMachine());
   assert(ret != nullptr);
   return ret;
 }
 
-auto getSymbolInProcess(const std::string &name)
-    -> decltype(llvm::RTDyldMemoryManager::getSymbolAddressInProcess(name)) {
-  assert(!name.empty());
-#if defined(_WIN32)
-  if ('_' == name[0]) {
-    return llvm::RTDyldMemoryManager::getSymbolAddressInProcess(name.substr(1));
-  }
-  return llvm::RTDyldMemoryManager::getSymbolAddressInProcess(name);
+#if LDC_LLVM_VER >= 1700
+using JitSymbol = llvm::orc::ExecutorSymbolDef;
+
+JitSymbol makeSymbol(void *ptr) {
+  return JitSymbol(llvm::orc::ExecutorAddr::fromPtr(ptr),
+                   llvm::JITSymbolFlags::Exported);
+}
+
+void *getSymbolAddress(const JitSymbol &symbol) {
+  return symbol.getAddress().toPtr<void *>();
+}
 #else
-  return llvm::RTDyldMemoryManager::getSymbolAddressInProcess(name);
-#endif
+using JitSymbol = llvm::JITEvaluatedSymbol;
+
+JitSymbol makeSymbol(void *ptr) {
+  return JitSymbol(llvm::pointerToJITTargetAddress(ptr),
+                   llvm::JITSymbolFlags::Exported);
 }
 
-} // anon namespace
+void *getSymbolAddress(const JitSymbol &symbol) {
+  return llvm::jitTargetAddressToPointer<void *>(symbol.getAddress());
+}
+#endif
 
-DynamicCompilerContext::ListenerCleaner::ListenerCleaner(
-    DynamicCompilerContext &o, llvm::raw_ostream *stream)
-    : owner(o) {
-  owner.listenerlayer.getTransform().stream = stream;
+void lazyCompileFailed() {
+  // There is no caller to report to, ORC has already printed the error.
+  Context context;
+  fatal(context, "Lazy compilation of dynamic function failed");
 }
 
-DynamicCompilerContext::ListenerCleaner::~ListenerCleaner() {
-  owner.listenerlayer.getTransform().stream = nullptr;
+void tierUpHandler(void *data, uint32_t index) {
+  assert(nullptr != data);
+  static_cast<DynamicCompilerContext *>(data)->requestTierUp(index);
+}
+
+// Compiles baseline tier modules with minimal codegen optimizations (i.e.
+// FastISel), everything else with the builder's settings. The target options
+// of the owning context are applied by `configure`.
+class JitIRCompiler final : public llvm::orc::IRCompileLayer::IRCompiler {
+public:
+  using Configure = std::function<void(llvm::TargetOptions &)>;
+
+private:
+  llvm::orc::JITTargetMachineBuilder jtmb;
+  llvm::ObjectCache *cache;
+  Configure configure;
+
+public:
+  JitIRCompiler(llvm::orc::JITTargetMachineBuilder builder,
+                llvm::ObjectCache *objCache, Configure conf)
+      : IRCompiler(llvm::orc::irManglingOptionsFromTargetOptions(
+            builder.getOptions())),
+        jtmb(std::move(builder)), cache(objCache),
+        configure(std::move(conf)) {}
+
+  llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>>
+  operator()(llvm::Module &module) override {
+    auto builder = jtmb;
+    configure(builder.getOptions());
+    if (isBaselineTier(module)) {
+#if LDC_LLVM_VER >= 1800
+      builder.setCodeGenOptLevel(llvm::CodeGenOptLevel::None);
+#else
+      builder.setCodeGenOptLevel(llvm::CodeGenOpt::None);
+#endif
+    }
+    auto tm = builder.createTargetMachine();
+    if (!tm) {
+      return tm.takeError();
+    }
+    return llvm::orc::SimpleCompiler(**tm, cache)(module);
+  }
+};
+
+} // anon namespace
+
+void makeInlineOnly(llvm::GlobalValue &value, const SymMap &hostSymbols,
+                    const llvm::DataLayout &layout) {
+  assert(!value.isDeclaration());
+  if (auto func = llvm::dyn_cast<llvm::Function>(&value)) {
+    llvm::SmallString<64> name;
+    llvm::Mangler::getNameWithPrefix(name, func->getName(), layout);
+    if (hostSymbols.count(name.str().str()) != 0) {
+      func->setLinkage(llvm::GlobalValue::AvailableExternallyLinkage);
+      func->setComdat(nullptr);
+    } else {
+      func->setLinkage(llvm::GlobalValue::InternalLinkage);
+    }
+  } else if (llvm::isa<llvm::GlobalVariable>(value)) {
+    value.setLinkage(llvm::GlobalValue::InternalLinkage);
+  }
 }
 
 DynamicCompilerContext::DynamicCompilerContext(bool isMainContext)
     : targetmachine(createTargetMachine()),
       dataLayout(targetmachine->createDataLayout()),
-      stringPool(std::make_shared<llvm::orc::SymbolStringPool>()),
-      execSession(stringPool), resolver(createResolver()),
-      objectLayer(execSession,
-                  [this](llvm::orc::VModuleKey) {
-                    return ObjectLayerT::Resources{
-                        std::make_shared<llvm::SectionMemoryManager>(),
-                        resolver};
-                  }),
-      listenerlayer(objectLayer, ModuleListener(*targetmachine)),
-      compileLayer(listenerlayer, llvm::orc::SimpleCompiler(*targetmachine)),
+      threadSafeContext(std::make_unique<llvm::LLVMContext>()),
       mainContext(isMainContext) {
   llvm::sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
 }
 
-DynamicCompilerContext::~DynamicCompilerContext() {}
+DynamicCompilerContext::~DynamicCompilerContext() {
+  waitForBackgroundTask();
+  stopTiering();
+}
 
 llvm::Error
 DynamicCompilerContext::addModule(std::unique_ptr<llvm::Module> module,
-                                  llvm::raw_ostream *asmListener) {
+                                  const JitSettings &settings) {
   assert(nullptr != module);
-  reset();
-
-  ListenerCleaner cleaner(*this, asmListener);
-  // Add the set to the JIT with the resolver we created above
-  auto handle = execSession.allocateVModule();
-  auto result = compileLayer.addModule(handle, std::move(module));
-  if (result) {
-    execSession.releaseVModule(handle);
-    return result;
-  }
-  if (auto err = compileLayer.emitAndFinalize(handle)) {
-    execSession.releaseVModule(handle);
+  if (auto err = createDylib(*module, settings)) {
     return err;
   }
-  moduleHandle = handle;
-  compiled = true;
-  return llvm::Error::success();
+
+  {
+    std::lock_guard<std::mutex> lock(lazyMutex);
+    lazyCompilation = settings.lazy;
+    lazySettings = settings.optimizer;
+    fpContract = settings.optimizer.options.fpContract;
+  }
+
+  if (settings.lazy) {
+    return jit->getCompileOnDemandLayer().add(
+        *dylibs.back(), llvm::orc::ThreadSafeModule(std::move(module),
+                                                    threadSafeContext));
+  }
+  return addEagerModule(std::move(module), settings);
 }
 
-llvm::JITSymbol DynamicCompilerContext::findSymbol(const std::string &name) {
-  return compileLayer.findSymbol(name, false);
+llvm::Expected<bool>
+DynamicCompilerContext::addCachedObjects(const llvm::Module &module,
+                                         const JitSettings &settings) {
+  assert(!settings.lazy);
+  assert(!settings.cacheKey.empty());
+  auto objects = JitObjectCache::load(settings.cacheDir, settings.cacheKey);
+  if (objects.empty()) {
+    return false;
+  }
+
+  if (auto err = createDylib(module, settings)) {
+    return std::move(err);
+  }
+  for (auto &&obj : objects) {
+    if (auto err = jit->addObjectFile(*dylibs.back(), std::move(obj))) {
+      return std::move(err);
+    }
+  }
+  return true;
+}
+
+llvm::Expected<std::vector<void *>>
+DynamicCompilerContext::lookup(llvm::ArrayRef<std::string> names,
+                               llvm::raw_ostream *listener) {
+  assert(nullptr != jit);
+  assert(!dylibs.empty());
+  auto &session = jit->getExecutionSession();
+  llvm::orc::SymbolLookupSet lookupSet;
+  for (auto &&name : names) {
+    lookupSet.add(session.intern(name));
+  }
+  // Binds with the same parameters share their function.
+  lookupSet.removeDuplicates();
+
+  asmListener = listener;
+  auto symbols = session.lookup(
+      llvm::orc::makeJITDylibSearchOrder(
+          {dylibs.back()}, llvm::orc::JITDylibLookupFlags::MatchAllSymbols),
+      std::move(lookupSet));
+  asmListener = nullptr;
+  if (!symbols) {
+    objectCache.cancel();
+    return symbols.takeError();
+  }
+  // Everything required is compiled now.
+  objectCache.finish();
+
+  std::vector<void *> ret;
+  ret.reserve(names.size());
+  for (auto &&name : names) {
+    auto it = symbols->find(session.intern(name));
+    assert(symbols->end() != it);
+    ret.push_back(getSymbolAddress(it->second));
+  }
+  return std::move(ret);
+}
+
+void DynamicCompilerContext::startStats() {
+  stats = Stats();
+  statsStart = std::chrono::steady_clock::now();
+  eventListener.resetCounts();
+}
+
+void DynamicCompilerContext::finishStats() {
+  stats.totalTime = static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - statsStart)
+          .count());
+  stats.codeSize = eventListener.getCodeSize();
+  stats.functionsCount = eventListener.getFunctionsCount();
+}
+
+void DynamicCompilerContext::setRegistration(bool debugger, bool perfMap) {
+  eventListener.setRegistration(debugger, perfMap);
+}
+
+JitOptions DynamicCompilerContext::getOptions() const {
+  return nullptr != options ? *options : getGlobalOptions();
+}
+
+void DynamicCompilerContext::setOptions(JitOptions newOptions) {
+  options = std::make_unique<JitOptions>(std::move(newOptions));
 }
 
 void DynamicCompilerContext::clearSymMap() { symMap.clear(); }
@@ -148,62 +313,498 @@ void DynamicCompilerContext::addSymbol(std::string &&name, void *value) {
 }
 
 void DynamicCompilerContext::reset() {
-  if (compiled) {
-    removeModule(moduleHandle);
-    moduleHandle = {};
-    compiled = false;
+  stopTiering();
+  for (auto tierUpDylib : tierUpDylibs) {
+    llvm::cantFail(jit->getExecutionSession().removeJITDylib(*tierUpDylib));
+  }
+  tierUpDylibs.clear();
+  tieredFunctions.clear();
+  tierUpBitcode.clear();
+  tierUpSymbols.clear();
+
+  objectCache.cancel();
+  for (auto it = dylibs.rbegin(); it != dylibs.rend(); ++it) {
+    llvm::cantFail(jit->getExecutionSession().removeJITDylib(**it));
+  }
+  dylibs.clear();
+  committedDylibs = 0;
+  compiledCode = CompiledCode();
+  // Only referenced by the removed code
+  profileCounters.clear();
+}
+
+void DynamicCompilerContext::discardIncrement() {
+  objectCache.cancel();
+  while (dylibs.size() > committedDylibs) {
+    llvm::cantFail(
+        jit->getExecutionSession().removeJITDylib(*dylibs.back()));
+    dylibs.pop_back();
   }
 }
 
+void DynamicCompilerContext::setCompiledCode(CompiledCode code) {
+  compiledCode = std::move(code);
+  committedDylibs = dylibs.size();
+}
+
+void DynamicCompilerContext::resetContext() {
+  // Modules still owned by the jit keep their context alive.
+  threadSafeContext =
+      llvm::orc::ThreadSafeContext(std::make_unique<llvm::LLVMContext>());
+}
+
 void DynamicCompilerContext::registerBind(
     void *handle, void *originalFunc, void *exampleFunc,
     const llvm::ArrayRef<ParamSlice> &params) {
+  std::lock_guard<std::mutex> lock(bindMutex);
   assert(bindInstances.count(handle) == 0);
   BindDesc::ParamsVec vec(params.begin(), params.end());
-  bindInstances.insert({handle, {originalFunc, exampleFunc, std::move(vec)}});
+  bindInstances.insert(
+      {handle, {originalFunc, exampleFunc, std::move(vec), ++bindCounter}});
 }
 
 void DynamicCompilerContext::unregisterBind(void *handle) {
+  std::lock_guard<std::mutex> lock(bindMutex);
   assert(bindInstances.count(handle) == 1);
   bindInstances.erase(handle);
 }
 
 bool DynamicCompilerContext::hasBindFunction(const void *handle) const {
   assert(handle != nullptr);
+  std::lock_guard<std::mutex> lock(bindMutex);
   auto it = bindInstances.find(const_cast<void *>(handle));
   return it != bindInstances.end();
 }
 
+void DynamicCompilerContext::updateBindHandle(void *handle, uint64_t bindId,
+                                              void *func, bool onlyIfUnset) {
+  assert(handle != nullptr);
+  std::lock_guard<std::mutex> lock(bindMutex);
+  auto it = bindInstances.find(handle);
+  if (it != bindInstances.end() && it->second.id == bindId &&
+      (!onlyIfUnset || nullptr == *static_cast<void **>(handle))) {
+    storeFunctionPointer(static_cast<void **>(handle), func);
+  }
+}
+
+void DynamicCompilerContext::clearBindHandles() {
+  std::lock_guard<std::mutex> lock(bindMutex);
+  for (auto &&bind : bindInstances) {
+    storeFunctionPointer(static_cast<void **>(bind.first), nullptr);
+  }
+}
+
+void DynamicCompilerContext::waitForBackgroundTask() {
+  if (backgroundTask.joinable()) {
+    backgroundTask.join();
+  }
+}
+
 bool DynamicCompilerContext::isMainContext() const { return mainContext; }
 
-void DynamicCompilerContext::removeModule(const ModuleHandleT &handle) {
-  cantFail(compileLayer.removeModule(handle));
-  execSession.releaseVModule(handle);
-}
-
-std::shared_ptr<llvm::orc::SymbolResolver>
-DynamicCompilerContext::createResolver() {
-  return llvm::orc::createLegacyLookupResolver(
-      execSession,
-      [this](llvm::StringRef name_) -> llvm::JITSymbol {
-        const std::string name = name_.str();
-        if (auto Sym = compileLayer.findSymbol(name, false)) {
-          return Sym;
-        } else if (auto Err = Sym.takeError()) {
-          return std::move(Err);
+llvm::Error DynamicCompilerContext::createJit(unsigned compileThreads) {
+  llvm::orc::LLLazyJITBuilder builder;
+  builder.setJITTargetMachineBuilder(createTargetMachineBuilder());
+  builder.setDataLayout(dataLayout);
+  builder.setNumCompileThreads(compileThreads);
+#if LDC_LLVM_VER >= 1600
+  builder.setLazyCompileFailureAddr(
+      llvm::orc::ExecutorAddr::fromPtr(&lazyCompileFailed));
+#else
+  builder.setLazyCompileFailureAddr(
+      llvm::pointerToJITTargetAddress(&lazyCompileFailed));
+#endif
+  builder.setCompileFunctionCreator(
+      [this](llvm::orc::JITTargetMachineBuilder jtmb)
+          -> llvm::Expected<
+              std::unique_ptr<llvm::orc::IRCompileLayer::IRCompiler>> {
+        return std::make_unique<JitIRCompiler>(
+            std::move(jtmb), &objectCache, [this](llvm::TargetOptions &opts) {
+              std::lock_guard<std::mutex> lock(lazyMutex);
+              opts.AllowFPOpFusion = fpContract;
+            });
+      });
+  builder.setObjectLinkingLayerCreator(
+      [this](llvm::orc::ExecutionSession &session, const llvm::Triple &triple)
+          -> llvm::Expected<std::unique_ptr<llvm::orc::ObjectLayer>> {
+        auto layer = std::make_unique<llvm::orc::RTDyldObjectLinkingLayer>(
+            session,
+            []() { return std::make_unique<llvm::SectionMemoryManager>(); });
+        layer->registerJITEventListener(eventListener);
+        if (triple.isOSBinFormatCOFF()) {
+          layer->setOverrideObjectFlagsWithResponsibilityFlags(true);
+          layer->setAutoClaimResponsibilityForObjectSymbols(true);
+        }
+        return std::unique_ptr<llvm::orc::ObjectLayer>(std::move(layer));
+      });
+
+  auto created = builder.create();
+  if (!created) {
+    return created.takeError();
+  }
+  jit = std::move(*created);
+  jitCompileThreads = compileThreads;
+
+  // Keep calls inside a partition direct, so bind wrappers can still inline
+  // the function they wrap. Everything else is compiled on its first call.
+  jit->setPartitionFunction(
+      [](llvm::orc::CompileOnDemandLayer::GlobalValueSet requested) {
+        llvm::SmallVector<const llvm::Function *, 8> worklist;
+        for (auto gv : requested) {
+          if (auto func = llvm::dyn_cast<llvm::Function>(gv)) {
+            worklist.push_back(func);
+          }
+        }
+        while (!worklist.empty()) {
+          auto func = worklist.pop_back_val();
+          for (auto &&bb : *func) {
+            for (auto &&inst : bb) {
+              auto call = llvm::dyn_cast<llvm::CallBase>(&inst);
+              if (nullptr == call) {
+                continue;
+              }
+              auto callee = call->getCalledFunction();
+              if (nullptr != callee && !callee->isDeclaration() &&
+                  (call->hasFnAttr(llvm::Attribute::AlwaysInline) ||
+                   callee->hasFnAttribute(llvm::Attribute::AlwaysInline)) &&
+                  requested.insert(callee).second) {
+                worklist.push_back(callee);
+              }
+            }
+          }
+        }
+        return requested;
+      });
+
+  // Lazily compiled partitions are optimized right before codegen, possibly
+  // on a compile thread. Eager modules are optimized by the caller.
+  jit->getIRTransformLayer().setTransform(
+      [this](llvm::orc::ThreadSafeModule tsm,
+             llvm::orc::MaterializationResponsibility &)
+          -> llvm::Expected<llvm::orc::ThreadSafeModule> {
+        OptimizerSettings settings;
+        {
+          std::lock_guard<std::mutex> lock(lazyMutex);
+          if (!lazyCompilation) {
+            return std::move(tsm);
+          }
+          settings = lazySettings;
+        }
+        // TargetMachine isn't thread-safe, use a private one.
+        auto tm = createTargetMachineBuilder().createTargetMachine();
+        if (!tm) {
+          return tm.takeError();
+        }
+        tsm.withModuleDo([&](llvm::Module &module) {
+          Context context;
+          optimizeModule(context, **tm, settings, module);
+        });
+        return std::move(tsm);
+      });
+
+  jit->getObjTransformLayer().setTransform(
+      [this](std::unique_ptr<llvm::MemoryBuffer> object)
+          -> llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>> {
+        if (nullptr != asmListener) {
+          auto objFile = llvm::object::ObjectFile::createObjectFile(
+              object->getMemBufferRef());
+          if (!objFile) {
+            return objFile.takeError();
+          }
+          disassemble(*targetmachine, **objFile, *asmListener);
         }
-        auto it = symMap.find(name);
-        if (symMap.end() != it) {
-          return llvm::JITSymbol(
-              reinterpret_cast<llvm::JITTargetAddress>(it->second),
-              llvm::JITSymbolFlags::Exported);
+        return std::move(object);
+      });
+
+  return llvm::Error::success();
+}
+
+llvm::Error DynamicCompilerContext::createDylib(const llvm::Module &module,
+                                                const JitSettings &settings) {
+  assert((settings.incremental != dylibs.empty()) &&
+         "reset() must be called before adding code");
+
+  // Thread count is fixed at LLJIT creation, nothing is compiled after reset()
+  // so the jit can be safely recreated. Incremental compilations use the
+  // same settings.
+  assert(!settings.incremental ||
+         jitCompileThreads == settings.compileThreads);
+  if (nullptr == jit || jitCompileThreads != settings.compileThreads) {
+    jit.reset();
+    if (auto err = createJit(settings.compileThreads)) {
+      return err;
+    }
+  }
+
+  auto newDylib = createDylibFor(module, symMap, settings.tiered);
+  if (!newDylib) {
+    return newDylib.takeError();
+  }
+  dylibs.push_back(&*newDylib);
+  return llvm::Error::success();
+}
+
+llvm::Expected<llvm::orc::JITDylib &>
+DynamicCompilerContext::createDylibFor(const llvm::Module &module,
+                                       const SymMap &hostSymbols,
+                                       bool tiered) {
+  auto newDylib =
+      jit->createJITDylib("ldc.jit." + std::to_string(dylibCounter++));
+  if (!newDylib) {
+    return newDylib.takeError();
+  }
+
+  // Symbols defined by the module itself take precedence over the ones
+  // provided by the host.
+  auto &session = jit->getExecutionSession();
+  llvm::orc::MangleAndInterner mangle(session, dataLayout);
+  llvm::orc::SymbolMap symbols;
+  for (auto &&sym : hostSymbols) {
+    symbols[session.intern(sym.first)] = makeSymbol(sym.second);
+  }
+  for (auto &&gv : module.global_values()) {
+    if (!gv.isDeclaration() && !gv.hasLocalLinkage()) {
+      symbols.erase(mangle(gv.getName()));
+    }
+  }
+  if (nullptr != module.getNamedValue(ProfileCountersName)) {
+    symbols[mangle(ProfileCountersName)] = makeSymbol(profileCounters.data());
+  }
+  if (tiered) {
+    symbols[mangle(TierUpHandlerName)] =
+        makeSymbol(reinterpret_cast<void *>(&tierUpHandler));
+    symbols[mangle(TierUpDataName)] = makeSymbol(this);
+  }
+  if (!symbols.empty()) {
+    if (auto err =
+            newDylib->define(llvm::orc::absoluteSymbols(std::move(symbols)))) {
+      return std::move(err);
+    }
+  }
+
+  auto generator =
+      llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+          dataLayout.getGlobalPrefix());
+  if (!generator) {
+    return generator.takeError();
+  }
+  newDylib->addGenerator(std::move(*generator));
+  return *newDylib;
+}
+
+void DynamicCompilerContext::prepareTiering(
+    llvm::Module &module, std::vector<TieredFunction> functions,
+    const JitSettings &settings) {
+  assert(settings.tiered || settings.profile);
+  assert(nullptr == tierUpWorker);
+  llvm::raw_svector_ostream os(tierUpBitcode);
+  llvm::WriteBitcodeToFile(module, os);
+  tierUpSymbols = symMap;
+  tierUpSettings = settings.optimizer;
+  tieredFunctions = std::move(functions);
+
+  if (settings.tiered) {
+    setBaselineTier(module);
+  }
+  // The profiled code is replaced after a fixed time instead of when it
+  // gets hot. Counters must be added before any other instrumentation.
+  if (settings.profile) {
+    profileCounters.assign(addProfileCounters(module), 0);
+    profileInterval = settings.profileInterval;
+    return;
+  }
+
+  std::vector<std::string> names;
+  names.reserve(tieredFunctions.size());
+  for (auto &&func : tieredFunctions) {
+    names.push_back(func.name);
+  }
+  addTierUpCounters(module, names, settings.tierUpThreshold);
+}
+
+void DynamicCompilerContext::startTiering() {
+  if (tieredFunctions.empty()) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(tierUpMutex);
+  assert(nullptr == tierUpWorker);
+  tierUpWorker = std::make_unique<TierUpWorker>(
+      [this](llvm::ArrayRef<uint32_t> indices) { tierUp(indices); });
+  if (!profileCounters.empty()) {
+    std::vector<uint32_t> indices(tieredFunctions.size());
+    std::iota(indices.begin(), indices.end(), 0);
+    tierUpWorker->requestAfter(std::chrono::milliseconds(profileInterval),
+                               std::move(indices));
+  }
+}
+
+void DynamicCompilerContext::requestTierUp(uint32_t index) {
+  std::lock_guard<std::mutex> lock(tierUpMutex);
+  if (nullptr != tierUpWorker) {
+    tierUpWorker->request(index);
+  }
+}
+
+void DynamicCompilerContext::stopTiering() {
+  std::unique_ptr<TierUpWorker> worker;
+  {
+    std::lock_guard<std::mutex> lock(tierUpMutex);
+    worker = std::move(tierUpWorker);
+  }
+  // Joins the worker, it never takes tierUpMutex itself.
+  worker.reset();
+}
+
+void DynamicCompilerContext::tierUp(llvm::ArrayRef<uint32_t> indices) {
+  // Counters can wrap around, so functions may be requested again.
+  llvm::SmallVector<uint32_t, 8> batch;
+  for (auto index : indices) {
+    assert(index < tieredFunctions.size());
+    auto &func = tieredFunctions[index];
+    if (!func.optimized) {
+      func.optimized = true;
+      batch.push_back(index);
+    }
+  }
+  if (batch.empty()) {
+    return;
+  }
+  // The baseline code keeps working if this fails.
+  llvm::consumeError(compileTierUp(batch));
+}
+
+llvm::Error
+DynamicCompilerContext::compileTierUp(llvm::ArrayRef<uint32_t> batch) {
+  auto context = std::make_unique<llvm::LLVMContext>();
+  auto module = llvm::parseBitcodeFile(
+      llvm::MemoryBufferRef(
+          llvm::StringRef(tierUpBitcode.data(), tierUpBitcode.size()),
+          "ldc.jit.tier_up"),
+      *context);
+  if (!module) {
+    return module.takeError();
+  }
+
+  if (!profileCounters.empty()) {
+    // Must see the module as it was instrumented. The profiled code may
+    // still be running, slightly stale counts don't matter.
+    applyProfile(**module, profileCounters);
+  }
+
+  llvm::StringSet<> hot;
+  for (auto index : batch) {
+    hot.insert(tieredFunctions[index].name);
+  }
+  // The other functions are only kept for inlining. Calls which aren't
+  // inlined go through the host thunks, or to private copies if there are
+  // none.
+  for (auto &&value : (*module)->global_values()) {
+    if (!value.isDeclaration() && !value.hasLocalLinkage() &&
+        hot.count(value.getName()) == 0) {
+      makeInlineOnly(value, tierUpSymbols, dataLayout);
+    }
+  }
+  auto &session = jit->getExecutionSession();
+  llvm::orc::MangleAndInterner mangle(session, dataLayout);
+
+  // TargetMachine isn't thread-safe, use a private one.
+  auto tm = createTargetMachineBuilder().createTargetMachine();
+  if (!tm) {
+    return tm.takeError();
+  }
+  {
+    Context optContext;
+    optimizeModule(optContext, **tm, tierUpSettings, **module);
+  }
+
+  auto newDylib = createDylibFor(**module, tierUpSymbols, false);
+  if (!newDylib) {
+    return newDylib.takeError();
+  }
+  tierUpDylibs.push_back(&*newDylib);
+  if (auto err = jit->addIRModule(
+          *newDylib, llvm::orc::ThreadSafeModule(std::move(*module),
+                                                 std::move(context)))) {
+    return err;
+  }
+
+  llvm::orc::SymbolLookupSet lookupSet;
+  for (auto index : batch) {
+    lookupSet.add(mangle(tieredFunctions[index].name));
+  }
+  auto symbols = session.lookup(
+      llvm::orc::makeJITDylibSearchOrder(
+          {&*newDylib}, llvm::orc::JITDylibLookupFlags::MatchAllSymbols),
+      std::move(lookupSet));
+  if (!symbols) {
+    return symbols.takeError();
+  }
+
+  for (auto index : batch) {
+    auto &func = tieredFunctions[index];
+    auto it = symbols->find(mangle(func.name));
+    assert(symbols->end() != it);
+    auto addr = getSymbolAddress(it->second);
+    for (auto &&target : func.targets) {
+      if (0 == target.bindId) {
+        storeFunctionPointer(target.ptr, addr);
+      } else {
+        updateBindHandle(target.ptr, target.bindId, addr);
+      }
+    }
+  }
+  return llvm::Error::success();
+}
+
+llvm::Error
+DynamicCompilerContext::addEagerModule(std::unique_ptr<llvm::Module> module,
+                                       const JitSettings &settings) {
+  const auto &cacheKey = settings.cacheKey;
+  if (!cacheKey.empty()) {
+    objectCache.start(settings.cacheDir, cacheKey);
+  }
+
+  if (settings.compileThreads <= 1) {
+    if (!cacheKey.empty()) {
+      module->setModuleIdentifier(JitObjectCache::getModuleId(cacheKey, 0));
+    }
+    return jit->addIRModule(
+        *dylibs.back(), llvm::orc::ThreadSafeModule(std::move(module),
+                                                    threadSafeContext));
+  }
+
+  // Modules sharing a context are compiled one at a time, so give each part
+  // its own context to let the compile threads work on them in parallel.
+  llvm::Error err = llvm::Error::success();
+  unsigned partIndex = 0;
+  llvm::SplitModule(
+      *module, settings.compileThreads,
+      [&](std::unique_ptr<llvm::Module> part) {
+        if (err) {
+          return;
+        }
+        llvm::SmallVector<char, 0> buffer;
+        llvm::raw_svector_ostream os(buffer);
+        llvm::WriteBitcodeToFile(*part, os);
+
+        auto partContext = std::make_unique<llvm::LLVMContext>();
+        auto newPart = llvm::parseBitcodeFile(
+            llvm::MemoryBufferRef(llvm::StringRef(buffer.data(), buffer.size()),
+                                  part->getModuleIdentifier()),
+            *partContext);
+        if (!newPart) {
+          err = newPart.takeError();
+          return;
         }
-        if (auto SymAddr = getSymbolInProcess(name)) {
-          return llvm::JITSymbol(SymAddr, llvm::JITSymbolFlags::Exported);
+        if (!cacheKey.empty()) {
+          (*newPart)->setModuleIdentifier(
+              JitObjectCache::getModuleId(cacheKey, partIndex));
         }
-        return nullptr;
-      },
-      [](llvm::Error Err) {
-        llvm::cantFail(std::move(Err), "lookupFlags failed");
+        ++partIndex;
+        err = jit->addIRModule(
+            *dylibs.back(),
+            llvm::orc::ThreadSafeModule(std::move(*newPart),
+                                        std::move(partContext)));
       });
+  return err;
 }
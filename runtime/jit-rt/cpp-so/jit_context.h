@@ -14,23 +14,29 @@
 
 #pragma once
 
+#include <chrono>
+#include <cstdint>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include "llvm/ADT/MapVector.h"
-#include "llvm/ExecutionEngine/JITSymbol.h"
-#include "llvm/ExecutionEngine/Orc/CompileUtils.h"
-#include "llvm/ExecutionEngine/Orc/IRCompileLayer.h"
-#include "llvm/ExecutionEngine/Orc/LambdaResolver.h"
-#include "llvm/ExecutionEngine/Orc/Legacy.h"
-#include "llvm/ExecutionEngine/Orc/ObjectTransformLayer.h"
-#include "llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/IR/DataLayout.h"
 #include "llvm/IR/LLVMContext.h"
-#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/Error.h"
 
 #include "context.h"
-#include "disassembler.h"
+#include "event_listener.h"
+#include "object_cache.h"
+#include "optimizer.h"
+#include "tiering.h"
 
 namespace llvm {
 class raw_ostream;
@@ -39,58 +45,126 @@ class TargetMachine;
 
 using SymMap = std::map<std::string, void *>;
 
+/// Turns a definition into a copy only used for inlining. Functions become
+/// available_externally if the host provides the symbol, everything else
+/// becomes internal.
+void makeInlineOnly(llvm::GlobalValue &value, const SymMap &hostSymbols,
+                    const llvm::DataLayout &layout);
+
+struct JitSettings final {
+  /// Defer codegen of each function until it is called for the first time.
+  bool lazy = false;
+  /// Number of ORC compile threads, 0 means compile on the calling thread.
+  unsigned compileThreads = 0;
+  /// Optimizer settings, lazily compiled functions are optimized right before
+  /// codegen.
+  OptimizerSettings optimizer;
+  /// Store eagerly compiled objects in cacheDir under cacheKey, the cache is
+  /// disabled if cacheKey is empty.
+  std::string cacheDir;
+  std::string cacheKey;
+  /// Compile at O0 first and recompile functions with the optimizer settings
+  /// once they have been called tierUpThreshold times.
+  bool tiered = false;
+  unsigned tierUpThreshold = 0;
+  /// Instrument the code and recompile it with the collected profile after
+  /// profileInterval milliseconds.
+  bool profile = false;
+  unsigned profileInterval = 0;
+  /// Add the module next to the previously compiled code instead of
+  /// replacing it.
+  bool incremental = false;
+};
+
+/// Describes the code of a context, so later compilations can reuse it.
+struct CompiledCode final {
+  struct Module final {
+    const void *irData = nullptr;
+    /// Sizes and raw values of the @dynamicCompileConst variables.
+    std::vector<size_t> varSizes;
+    std::string varValues;
+  };
+  /// Hash of the settings and the whole code.
+  std::string codeKey;
+  /// Hash of the settings alone, code can only be added if they are the same.
+  std::string settingsKey;
+  /// Compiled modules by their module list entry.
+  std::unordered_map<const void *, Module> modules;
+  /// Addresses of the compiled bind specializations by their bind key.
+  std::unordered_map<std::string, void *> binds;
+};
+
+/// Entry function of the jitted code, see DynamicCompilerContext::prepareTiering.
+struct TieredFunction final {
+  struct Target final {
+    void **ptr;
+    /// Bind id for bind handles, 0 for thunk variables.
+    uint64_t bindId;
+  };
+  std::string name;
+  llvm::SmallVector<Target, 1> targets;
+  bool optimized = false;
+};
+
 class DynamicCompilerContext final {
 private:
-  struct ModuleListener {
-    llvm::TargetMachine &targetmachine;
-    llvm::raw_ostream *stream = nullptr;
-
-    ModuleListener(llvm::TargetMachine &tm) : targetmachine(tm) {}
-
-    template <typename T> auto operator()(T &&object) -> T {
-      if (nullptr != stream) {
-        auto objFile =
-            llvm::cantFail(llvm::object::ObjectFile::createObjectFile(
-                object->getMemBufferRef()));
-        disassemble(targetmachine, *objFile, *stream);
-      }
-      return std::move(object);
-    }
-  };
   std::unique_ptr<llvm::TargetMachine> targetmachine;
   const llvm::DataLayout dataLayout;
-  using ObjectLayerT = llvm::orc::LegacyRTDyldObjectLinkingLayer;
-  using ListenerLayerT =
-      llvm::orc::LegacyObjectTransformLayer<ObjectLayerT, ModuleListener>;
-  using CompileLayerT =
-      llvm::orc::LegacyIRCompileLayer<ListenerLayerT,
-                                      llvm::orc::SimpleCompiler>;
-  using ModuleHandleT = llvm::orc::VModuleKey;
-  std::shared_ptr<llvm::orc::SymbolStringPool> stringPool;
-  llvm::orc::ExecutionSession execSession;
-  std::shared_ptr<llvm::orc::SymbolResolver> resolver;
-  ObjectLayerT objectLayer;
-  ListenerLayerT listenerlayer;
-  CompileLayerT compileLayer;
-  llvm::LLVMContext context;
-  bool compiled = false;
-  ModuleHandleT moduleHandle;
+  // Must outlive the jit, which notifies it about freed objects.
+  JitEventListener eventListener;
+  std::unique_ptr<llvm::orc::LLLazyJIT> jit;
+  unsigned jitCompileThreads = 0;
+  unsigned dylibCounter = 0;
+  // The code of a full compilation followed by the incrementally added code.
+  std::vector<llvm::orc::JITDylib *> dylibs;
+  size_t committedDylibs = 0;
+  llvm::orc::ThreadSafeContext threadSafeContext;
   SymMap symMap;
+  // Describes the code in dylibs, see setCompiledCode().
+  CompiledCode compiledCode;
+  // Set through setDynamicCompilerOptions for this context.
+  std::unique_ptr<JitOptions> options;
+  Stats stats;
+  std::chrono::steady_clock::time_point statsStart;
+
+  // Shared with ORC compile threads.
+  std::mutex lazyMutex;
+  bool lazyCompilation = false;
+  OptimizerSettings lazySettings;
+  llvm::FPOpFusion::FPOpFusionMode fpContract = llvm::FPOpFusion::Standard;
+  // Only set for the duration of lookup, accessed from the object transform.
+  llvm::raw_ostream *asmListener = nullptr;
+  JitObjectCache objectCache;
+
+  // Compiles and publishes the code of an asynchronous compileDynamicCode call.
+  std::thread backgroundTask;
 
   struct BindDesc final {
     void *originalFunc;
     void *exampleFunc;
     using ParamsVec = llvm::SmallVector<ParamSlice, 5>;
     ParamsVec params;
+    // Distinguishes binds reusing the handle of an unregistered one.
+    uint64_t id;
   };
+  // Guards bindInstances against the background task updating bind handles.
+  mutable std::mutex bindMutex;
   llvm::MapVector<void *, BindDesc> bindInstances;
+  uint64_t bindCounter = 0;
   const bool mainContext = false;
 
-  struct ListenerCleaner final {
-    DynamicCompilerContext &owner;
-    ListenerCleaner(DynamicCompilerContext &o, llvm::raw_ostream *stream);
-    ~ListenerCleaner();
-  };
+  // Tiered compilation, only accessed by the tier up worker once it runs.
+  std::vector<TieredFunction> tieredFunctions;
+  llvm::SmallVector<char, 0> tierUpBitcode;
+  SymMap tierUpSymbols;
+  OptimizerSettings tierUpSettings;
+  std::vector<llvm::orc::JITDylib *> tierUpDylibs;
+  // Written by the profiled code.
+  std::vector<uint64_t> profileCounters;
+  unsigned profileInterval = 0;
+  // Guards tierUpWorker against requests from jitted code.
+  std::mutex tierUpMutex;
+  std::unique_ptr<TierUpWorker> tierUpWorker;
 
 public:
   DynamicCompilerContext(bool isMainContext);
@@ -99,19 +173,63 @@ public:
   llvm::TargetMachine &getTargetMachine() { return *targetmachine; }
   const llvm::DataLayout &getDataLayout() const { return dataLayout; }
 
+  /// Adds the module to a fresh JIT dylib, which replaces the previous code
+  /// unless settings.incremental is set. Unless lazy compilation is
+  /// requested the code is generated by the following lookup() call.
   llvm::Error addModule(std::unique_ptr<llvm::Module> module,
-                        llvm::raw_ostream *asmListener);
+                        const JitSettings &settings);
 
-  llvm::JITSymbol findSymbol(const std::string &name);
+  /// Adds the objects cached for settings.cacheKey instead of compiling the
+  /// module, returns false if there are none.
+  llvm::Expected<bool> addCachedObjects(const llvm::Module &module,
+                                        const JitSettings &settings);
 
-  llvm::LLVMContext &getContext() { return context; }
+  /// Resolves all (decorated) names of the last added module in one go, so
+  /// independent parts of it can be compiled concurrently.
+  llvm::Expected<std::vector<void *>>
+  lookup(llvm::ArrayRef<std::string> names, llvm::raw_ostream *asmListener);
+
+  llvm::LLVMContext &getContext() { return *threadSafeContext.getContext(); }
 
   void clearSymMap();
 
   void addSymbol(std::string &&name, void *value);
 
+  /// Host symbols of the last compiled modules.
+  const SymMap &getSymbols() const { return symMap; }
+
+  /// Removes all previously compiled code.
   void reset();
 
+  /// Starts a new LLVM context, previously compiled code stays available.
+  void resetContext();
+
+  /// Removes the code added since the last setCompiledCode() call by an
+  /// incremental compilation.
+  void discardIncrement();
+
+  /// What the compiled code was generated from, used to keep the code or to
+  /// add to it if compileDynamicCode is called again. Empty if there is no
+  /// code.
+  const CompiledCode &getCompiledCode() const { return compiledCode; }
+  void setCompiledCode(CompiledCode code);
+
+  /// Statistics of the last compilation, the stage times are added by the
+  /// compilation itself.
+  Stats &getStats() { return stats; }
+  /// Starts collecting statistics for a new compilation.
+  void startStats();
+  /// Records the total time and the generated code.
+  void finishStats();
+
+  /// Registers the code loaded from now on with debuggers and in the perf
+  /// map.
+  void setRegistration(bool debugger, bool perfMap);
+
+  /// Options of this context, the global ones if none were set.
+  JitOptions getOptions() const;
+  void setOptions(JitOptions newOptions);
+
   void registerBind(void *handle, void *originalFunc, void *exampleFunc,
                     const llvm::ArrayRef<ParamSlice> &params);
 
@@ -119,6 +237,37 @@ public:
 
   bool hasBindFunction(const void *handle) const;
 
+  /// Points the bind handle to the compiled function unless the bind has been
+  /// unregistered in the meantime. With onlyIfUnset handles which already
+  /// point to code are kept.
+  void updateBindHandle(void *handle, uint64_t bindId, void *func,
+                        bool onlyIfUnset = false);
+
+  /// Makes all registered binds uncallable until they are compiled again.
+  void clearBindHandles();
+
+  /// Runs the task on a background thread after the previous one finished.
+  template <typename F> void runInBackground(F &&task) {
+    waitForBackgroundTask();
+    backgroundTask = std::thread(std::forward<F>(task));
+  }
+
+  /// Blocks until the code of the last asynchronous compilation is published.
+  void waitForBackgroundTask();
+
+  /// Keeps an unoptimized copy of the module for recompiling hot functions
+  /// and adds call counters to the functions, or profile counters to the
+  /// whole module with settings.profile.
+  void prepareTiering(llvm::Module &module,
+                      std::vector<TieredFunction> functions,
+                      const JitSettings &settings);
+
+  /// Starts handling tier up requests, the baseline code must be installed.
+  void startTiering();
+
+  /// Queues the function for optimized recompilation, called by jitted code.
+  void requestTierUp(uint32_t index);
+
   const llvm::MapVector<void *, BindDesc> &getBindInstances() const {
     return bindInstances;
   }
@@ -126,7 +275,21 @@ public:
   bool isMainContext() const;
 
 private:
-  void removeModule(const ModuleHandleT &handle);
+  llvm::Error createJit(unsigned compileThreads);
+
+  llvm::Error createDylib(const llvm::Module &module,
+                          const JitSettings &settings);
+
+  llvm::Expected<llvm::orc::JITDylib &>
+  createDylibFor(const llvm::Module &module, const SymMap &symbols,
+                 bool tiered);
+
+  void stopTiering();
+
+  void tierUp(llvm::ArrayRef<uint32_t> indices);
+
+  llvm::Error compileTierUp(llvm::ArrayRef<uint32_t> batch);
 
-  std::shared_ptr<llvm::orc::SymbolResolver> createResolver();
+  llvm::Error addEagerModule(std::unique_ptr<llvm::Module> module,
+                             const JitSettings &settings);
 };
@@ -0,0 +1,136 @@
+//===-- object_cache.cpp --------------------------------------------------===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the Boost Software License. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "object_cache.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace {
+std::string getPath(llvm::StringRef dir, llvm::StringRef name,
+                    llvm::StringRef ext) {
+  llvm::SmallString<128> path(dir);
+  llvm::sys::path::append(path, name + ext);
+  return std::string(path.str());
+}
+
+// Cache is best effort, failing to write it isn't an error.
+void writeFile(const std::string &path, llvm::StringRef data) {
+  auto err = llvm::writeToOutput(path, [&](llvm::raw_ostream &os) {
+    os << data;
+    return llvm::Error::success();
+  });
+  llvm::consumeError(std::move(err));
+}
+} // anon namespace
+
+std::string JitObjectCache::getModuleId(llvm::StringRef key, unsigned part) {
+  return (key + "." + llvm::Twine(part)).str();
+}
+
+std::vector<std::unique_ptr<llvm::MemoryBuffer>>
+JitObjectCache::load(llvm::StringRef dir, llvm::StringRef key) {
+  std::vector<std::unique_ptr<llvm::MemoryBuffer>> ret;
+  auto index = llvm::MemoryBuffer::getFile(getPath(dir, key, ".idx"));
+  if (!index) {
+    return ret;
+  }
+  llvm::SmallVector<llvm::StringRef, 8> names;
+  (*index)->getBuffer().split(names, '\n', -1, /*KeepEmpty*/ false);
+  for (auto &&name : names) {
+    auto obj = llvm::MemoryBuffer::getFile(getPath(dir, name, ".o"));
+    if (!obj) {
+      return {};
+    }
+    ret.emplace_back(std::move(*obj));
+  }
+  return ret;
+}
+
+void JitObjectCache::start(llvm::StringRef newDir, llvm::StringRef newKey) {
+  std::lock_guard<std::mutex> lock(mutex);
+  dir = newDir.str();
+  key = newKey.str();
+  objects.clear();
+  llvm::sys::fs::create_directories(dir);
+}
+
+void JitObjectCache::finish() {
+  std::string index;
+  std::string path;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (key.empty()) {
+      return;
+    }
+    for (auto &&name : objects) {
+      index += name;
+      index += '\n';
+    }
+    path = getPath(dir, key, ".idx");
+    key.clear();
+    objects.clear();
+  }
+  writeFile(path, index);
+}
+
+void JitObjectCache::cancel() {
+  std::lock_guard<std::mutex> lock(mutex);
+  key.clear();
+  objects.clear();
+}
+
+void JitObjectCache::notifyObjectCompiled(const llvm::Module *module,
+                                          llvm::MemoryBufferRef obj) {
+  assert(nullptr != module);
+  const auto &moduleId = module->getModuleIdentifier();
+  std::string path;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!isRecorded(moduleId)) {
+      return;
+    }
+    objects.push_back(moduleId);
+    path = getPath(dir, moduleId, ".o");
+  }
+  writeFile(path, obj.getBuffer());
+}
+
+std::unique_ptr<llvm::MemoryBuffer>
+JitObjectCache::getObject(const llvm::Module *module) {
+  assert(nullptr != module);
+  const auto &moduleId = module->getModuleIdentifier();
+  std::string path;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!isRecorded(moduleId)) {
+      return nullptr;
+    }
+    path = getPath(dir, moduleId, ".o");
+  }
+  auto obj = llvm::MemoryBuffer::getFile(path);
+  if (!obj) {
+    return nullptr;
+  }
+  // Objects of an interrupted compilation, still part of this one.
+  std::lock_guard<std::mutex> lock(mutex);
+  if (isRecorded(moduleId)) {
+    objects.push_back(moduleId);
+  }
+  return std::move(*obj);
+}
+
+bool JitObjectCache::isRecorded(llvm::StringRef moduleId) const {
+  return !key.empty() && moduleId.size() > key.size() &&
+         moduleId.substr(0, key.size()) == key && moduleId[key.size()] == '.';
+}
@@ -0,0 +1,59 @@
+//===-- object_cache.h - jit support ----------------------------*- C++ -*-===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the Boost Software License. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Jit runtime - persistent on-disk object cache.
+// Objects are stored as <dir>/<key>.<n>.o, <dir>/<key>.idx lists the objects
+// of a complete compilation.
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ExecutionEngine/ObjectCache.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+class JitObjectCache final : public llvm::ObjectCache {
+  std::mutex mutex;
+  std::string dir;
+  std::string key;
+  std::vector<std::string> objects;
+
+public:
+  /// Module identifier for the n-th part of the compilation with this key.
+  static std::string getModuleId(llvm::StringRef key, unsigned part);
+
+  /// Loads all objects of a complete compilation, returns an empty vector if
+  /// there is none.
+  static std::vector<std::unique_ptr<llvm::MemoryBuffer>>
+  load(llvm::StringRef dir, llvm::StringRef key);
+
+  /// Starts recording objects compiled for modules of this key.
+  void start(llvm::StringRef dir, llvm::StringRef key);
+
+  /// Writes the index of the recorded objects and stops recording.
+  void finish();
+
+  /// Stops recording, the stored objects won't be used.
+  void cancel();
+
+  void notifyObjectCompiled(const llvm::Module *module,
+                            llvm::MemoryBufferRef obj) override;
+
+  std::unique_ptr<llvm::MemoryBuffer>
+  getObject(const llvm::Module *module) override;
+
+private:
+  bool isRecorded(llvm::StringRef moduleId) const;
+};
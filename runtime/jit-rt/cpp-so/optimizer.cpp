@@ -15,7 +15,7 @@
 
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/DataLayout.h"
-#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/DebugInfo.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Verifier.h"
 
@@ -28,182 +28,114 @@
 #include "llvm/Analysis/TargetLibraryInfo.h"
 #include "llvm/Analysis/TargetTransformInfo.h"
 
-#include "llvm/Support/CommandLine.h"
+#include "llvm/Passes/PassBuilder.h"
 
-#include "llvm/Transforms/IPO.h"
-#include "llvm/Transforms/IPO/AlwaysInliner.h"
-#include "llvm/Transforms/IPO/Inliner.h"
-#include "llvm/Transforms/IPO/PassManagerBuilder.h"
+#include "llvm/Transforms/IPO/GlobalDCE.h"
+#include "llvm/Transforms/IPO/StripDeadPrototypes.h"
+#include "llvm/Transforms/IPO/StripSymbols.h"
 
 #include "context.h"
 #include "utils.h"
 #include "valueparser.h"
 
 #ifdef LDC_DYNAMIC_COMPILE_USE_CUSTOM_PASSES
-#include "Passes.h"
+#include "GarbageCollect2Stack.h"
+#include "SimplifyDRuntimeCalls.h"
+#include "StripExternals.h"
 #endif
 
 namespace {
-namespace cl = llvm::cl;
-cl::opt<bool>
-    verifyEach("verify-each", cl::ZeroOrMore, cl::Hidden,
-               cl::desc("Run verifier after D-specific and explicitly "
-                        "specified optimization passes"));
-
 /// LDC LICENSE START
 #ifdef LDC_DYNAMIC_COMPILE_USE_CUSTOM_PASSES
-cl::opt<bool>
-    disableLangSpecificPasses("disable-d-passes", cl::ZeroOrMore,
-                              cl::desc("Disable all D-specific passes"));
-
-cl::opt<bool> disableSimplifyDruntimeCalls(
-    "disable-simplify-drtcalls", cl::ZeroOrMore,
-    cl::desc("Disable simplification of druntime calls"));
-
-cl::opt<bool> disableSimplifyLibCalls(
-    "disable-simplify-libcalls", cl::ZeroOrMore,
-    cl::desc("Disable simplification of well-known C runtime calls"));
-
-cl::opt<bool> disableGCToStack(
-    "disable-gc2stack", cl::ZeroOrMore,
-    cl::desc("Disable promotion of GC allocations to stack memory"));
-#endif
-/// LDC LICENSE END
-
-cl::opt<bool> stripDebug(
-    "strip-debug", cl::ZeroOrMore,
-    cl::desc("Strip symbolic debug information before optimization"));
-
-cl::opt<bool> disableLoopUnrolling(
-    "disable-loop-unrolling", cl::ZeroOrMore,
-    cl::desc("Disable loop unrolling in all relevant passes"));
-cl::opt<bool>
-    disableLoopVectorization("disable-loop-vectorization", cl::ZeroOrMore,
-                             cl::desc("Disable the loop vectorization pass"));
-
-cl::opt<bool>
-    disableSLPVectorization("disable-slp-vectorization", cl::ZeroOrMore,
-                            cl::desc("Disable the slp vectorization pass"));
-
-/// LDC LICENSE START
-#ifdef LDC_DYNAMIC_COMPILE_USE_CUSTOM_PASSES
-void addPass(llvm::PassManagerBase &pm, llvm::Pass *pass) {
-  pm.add(pass);
-
-  if (verifyEach) {
-    pm.add(llvm::createVerifierPass());
-  }
+bool isFullOptimization(llvm::OptimizationLevel level) {
+  return level == llvm::OptimizationLevel::O2 ||
+         level == llvm::OptimizationLevel::O3;
 }
 
-void addStripExternalsPass(const llvm::PassManagerBuilder &builder,
-                           llvm::PassManagerBase &pm) {
-  if (builder.OptLevel >= 1) {
-    addPass(pm, createStripExternalsPass());
-    addPass(pm, llvm::createGlobalDCEPass());
+void addStripExternalsPass(llvm::ModulePassManager &mpm,
+                           llvm::OptimizationLevel level, bool verifyEach) {
+  if (level == llvm::OptimizationLevel::O1 || isFullOptimization(level)) {
+    mpm.addPass(StripExternalsPass());
+    if (verifyEach) {
+      mpm.addPass(llvm::VerifierPass());
+    }
+    mpm.addPass(llvm::GlobalDCEPass());
   }
 }
 
-void addSimplifyDRuntimeCallsPass(const llvm::PassManagerBuilder &builder,
-                                  llvm::PassManagerBase &pm) {
-  if (builder.OptLevel >= 2 && builder.SizeLevel == 0) {
-    addPass(pm, createSimplifyDRuntimeCalls());
+void addSimplifyDRuntimeCallsPass(llvm::ModulePassManager &mpm,
+                                  llvm::OptimizationLevel level,
+                                  bool verifyEach) {
+  if (isFullOptimization(level)) {
+    mpm.addPass(
+        llvm::createModuleToFunctionPassAdaptor(SimplifyDRuntimeCallsPass()));
+    if (verifyEach) {
+      mpm.addPass(llvm::VerifierPass());
+    }
   }
 }
 
-void addGarbageCollect2StackPass(const llvm::PassManagerBuilder &builder,
-                                 llvm::PassManagerBase &pm) {
-  if (builder.OptLevel >= 2 && builder.SizeLevel == 0) {
-    addPass(pm, createGarbageCollect2Stack());
+void addGarbageCollect2StackPass(llvm::ModulePassManager &mpm,
+                                 llvm::OptimizationLevel level,
+                                 bool verifyEach) {
+  if (isFullOptimization(level)) {
+    mpm.addPass(
+        llvm::createModuleToFunctionPassAdaptor(GarbageCollect2StackPass()));
+    if (verifyEach) {
+      mpm.addPass(llvm::VerifierPass());
+    }
   }
 }
 #endif
 /// LDC LICENSE END
 
-// TODO: share this function with compiler
-void addOptimizationPasses(llvm::legacy::PassManagerBase &mpm,
-                           llvm::legacy::FunctionPassManager &fpm,
-                           unsigned optLevel, unsigned sizeLevel) {
-  llvm::PassManagerBuilder builder;
-  builder.OptLevel = optLevel;
-  builder.SizeLevel = sizeLevel;
-
-  // TODO: expose this option from jit
-  if (/*willInline()*/ true) {
-    auto params = llvm::getInlineParams(optLevel, sizeLevel);
-    builder.Inliner = llvm::createFunctionInliningPass(params);
-  } else {
-    builder.Inliner = llvm::createAlwaysInlinerLegacyPass();
+llvm::OptimizationLevel getOptimizationLevel(const OptimizerSettings &settings) {
+  if (settings.optLevel == 0) {
+    return llvm::OptimizationLevel::O0;
   }
+  if (settings.sizeLevel == 1) {
+    return llvm::OptimizationLevel::Os;
+  }
+  if (settings.sizeLevel >= 2) {
+    return llvm::OptimizationLevel::Oz;
+  }
+  switch (settings.optLevel) {
+  case 1:
+    return llvm::OptimizationLevel::O1;
+  case 2:
+    return llvm::OptimizationLevel::O2;
+  default:
+    return llvm::OptimizationLevel::O3;
+  }
+}
 
-  builder.DisableUnrollLoops = (disableLoopUnrolling.getNumOccurrences() > 0)
-                                   ? disableLoopUnrolling
-                                   : optLevel == 0;
-
-  if (disableLoopVectorization) {
-    builder.LoopVectorize = false;
+// TODO: share this function with compiler
+llvm::PipelineTuningOptions
+getPipelineTuningOptions(const OptimizerSettings &settings) {
+  const auto optLevel = settings.optLevel;
+  const auto sizeLevel = settings.sizeLevel;
+  const auto &options = settings.options;
+  llvm::PipelineTuningOptions pto;
+
+  pto.LoopUnrolling = !(options.disableLoopUnrolling >= 0
+                            ? options.disableLoopUnrolling != 0
+                            : optLevel == 0);
+
+  if (options.disableLoopVectorization) {
+    pto.LoopVectorization = false;
     // If option wasn't forced via cmd line (-vectorize-loops, -loop-vectorize)
-  } else if (!builder.LoopVectorize) {
-    builder.LoopVectorize = optLevel > 1 && sizeLevel < 2;
+  } else if (!pto.LoopVectorization) {
+    pto.LoopVectorization = optLevel > 1 && sizeLevel < 2;
   }
 
-  builder.SLPVectorize =
-      disableSLPVectorization ? false : optLevel > 1 && sizeLevel < 2;
+  pto.SLPVectorization =
+      options.disableSLPVectorization ? false : optLevel > 1 && sizeLevel < 2;
 
   // TODO: sanitizers support in jit?
   // TODO: PGO support in jit?
-
-  /// LDC LICENSE START
-#ifdef LDC_DYNAMIC_COMPILE_USE_CUSTOM_PASSES
-  if (!disableLangSpecificPasses) {
-    if (!disableSimplifyDruntimeCalls) {
-      builder.addExtension(llvm::PassManagerBuilder::EP_LoopOptimizerEnd,
-                           addSimplifyDRuntimeCallsPass);
-    }
-
-    if (!disableGCToStack) {
-      builder.addExtension(llvm::PassManagerBuilder::EP_LoopOptimizerEnd,
-                           addGarbageCollect2StackPass);
-    }
-  }
-
-  // EP_OptimizerLast does not exist in LLVM 3.0, add it manually below.
-  builder.addExtension(llvm::PassManagerBuilder::EP_OptimizerLast,
-                       addStripExternalsPass);
-#endif
-  /// LDC LICENSE END
-
-  builder.populateFunctionPassManager(fpm);
-  builder.populateModulePassManager(mpm);
+  return pto;
 }
 
-void setupPasses(llvm::TargetMachine &targetMachine,
-                 const OptimizerSettings &settings,
-                 llvm::legacy::PassManager &mpm,
-                 llvm::legacy::FunctionPassManager &fpm) {
-  mpm.add(
-      new llvm::TargetLibraryInfoWrapperPass(targetMachine.getTargetTriple()));
-  mpm.add(llvm::createTargetTransformInfoWrapperPass(
-      targetMachine.getTargetIRAnalysis()));
-  fpm.add(llvm::createTargetTransformInfoWrapperPass(
-      targetMachine.getTargetIRAnalysis()));
-
-  if (stripDebug) {
-    mpm.add(llvm::createStripSymbolsPass(true));
-  }
-  mpm.add(llvm::createStripDeadPrototypesPass());
-  mpm.add(llvm::createStripDeadDebugInfoPass());
-
-  addOptimizationPasses(mpm, fpm, settings.optLevel, settings.sizeLevel);
-}
-
-struct FuncFinalizer final {
-  llvm::legacy::FunctionPassManager &fpm;
-  explicit FuncFinalizer(llvm::legacy::FunctionPassManager &_fpm) : fpm(_fpm) {
-    fpm.doInitialization();
-  }
-  ~FuncFinalizer() { fpm.doFinalization(); }
-};
-
 void stripComdat(llvm::Module &module) {
   for (auto &&func : module.functions()) {
     func.setComdat(nullptr);
@@ -221,29 +153,71 @@ void optimizeModule(const Context &context, llvm::TargetMachine &targetMachine,
   // There is llvm bug related tp comdat and IR based pgo
   // and anyway comdat is useless at this stage
   stripComdat(module);
-  llvm::legacy::PassManager mpm;
-  llvm::legacy::FunctionPassManager fpm(&module);
   const auto name = module.getName();
   interruptPoint(context, "Setup passes for module", name.data());
-  setupPasses(targetMachine, settings, mpm, fpm);
-
-  // Run per-function passes.
-  {
-    FuncFinalizer finalizer(fpm);
-    for (auto &fun : module) {
-      if (fun.isDeclaration()) {
-        interruptPoint(context, "Func decl", fun.getName().data());
-      } else {
-        interruptPoint(context, "Run passes for function",
-                       fun.getName().data());
-      }
-      fpm.run(fun);
+
+  llvm::LoopAnalysisManager lam;
+  llvm::FunctionAnalysisManager fam;
+  llvm::CGSCCAnalysisManager cgam;
+  llvm::ModuleAnalysisManager mam;
+
+  llvm::PassBuilder pb(&targetMachine, getPipelineTuningOptions(settings));
+
+  const auto &options = settings.options;
+  llvm::TargetLibraryInfoImpl tlii(targetMachine.getTargetTriple());
+  /// LDC LICENSE START
+#ifdef LDC_DYNAMIC_COMPILE_USE_CUSTOM_PASSES
+  if (options.disableSimplifyLibCalls) {
+    tlii.disableAllFunctions();
+  }
+
+  const bool verifyEach = options.verifyEach;
+  if (!options.disableLangSpecificPasses) {
+    if (!options.disableSimplifyDruntimeCalls) {
+      pb.registerOptimizerLastEPCallback(
+          [=](llvm::ModulePassManager &mpm, llvm::OptimizationLevel level) {
+            addSimplifyDRuntimeCallsPass(mpm, level, verifyEach);
+          });
     }
+    if (!options.disableGCToStack) {
+      pb.registerOptimizerLastEPCallback(
+          [=](llvm::ModulePassManager &mpm, llvm::OptimizationLevel level) {
+            addGarbageCollect2StackPass(mpm, level, verifyEach);
+          });
+    }
+  }
+
+  pb.registerOptimizerLastEPCallback(
+      [=](llvm::ModulePassManager &mpm, llvm::OptimizationLevel level) {
+        addStripExternalsPass(mpm, level, verifyEach);
+      });
+#endif
+  /// LDC LICENSE END
+  fam.registerPass([&] { return llvm::TargetLibraryAnalysis(tlii); });
+
+  pb.registerModuleAnalyses(mam);
+  pb.registerCGSCCAnalyses(cgam);
+  pb.registerFunctionAnalyses(fam);
+  pb.registerLoopAnalyses(lam);
+  pb.crossRegisterProxies(lam, fam, cgam, mam);
+
+  if (options.stripDebug) {
+    llvm::StripDebugInfo(module);
+  }
+
+  llvm::ModulePassManager mpm;
+  mpm.addPass(llvm::StripDeadPrototypesPass());
+  mpm.addPass(llvm::StripDeadDebugInfoPass());
+
+  const auto level = getOptimizationLevel(settings);
+  if (level == llvm::OptimizationLevel::O0) {
+    mpm.addPass(pb.buildO0DefaultPipeline(level));
+  } else {
+    mpm.addPass(pb.buildPerModuleDefaultPipeline(level));
   }
 
-  // Run per-module passes.
   interruptPoint(context, "Run passes for module", name.data());
-  mpm.run(module);
+  mpm.run(module, mam);
 }
 
 void setRtCompileVar(const Context &context, llvm::Module &module,
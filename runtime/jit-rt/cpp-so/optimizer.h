@@ -15,11 +15,9 @@
 
 #include <memory>
 
+#include "options.h"
+
 namespace llvm {
-namespace legacy {
-class PassManager;
-class FunctionPassManager;
-}
 class TargetMachine;
 class Module;
 }
@@ -29,6 +27,7 @@ struct Context;
 struct OptimizerSettings final {
   unsigned optLevel = 0;
   unsigned sizeLevel = 0;
+  JitOptions options;
 };
 
 void optimizeModule(const Context &context, llvm::TargetMachine &targetMachine,
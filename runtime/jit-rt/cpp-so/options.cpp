@@ -9,25 +9,128 @@
 
 #include "options.h"
 
+#include <mutex>
+
 #include "callback_ostream.h"
 
 #include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
 #include "llvm/Support/CommandLine.h"
 
-bool parseOptions(Slice<Slice<const char>> args,
-                  void (*errs)(void *, const char *, size_t),
-                  void *errsContext) {
-  llvm::SmallVector<std::string, 32 - 1> tempStrs;
-  tempStrs.reserve(args.len);
+namespace {
+std::mutex &optionsMutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+JitOptions &globalOptions() {
+  static JitOptions options;
+  return options;
+}
+
+std::string &llvmOptions() {
+  static std::string options;
+  return options;
+}
+
+struct BoolOption final {
+  const char *name;
+  bool JitOptions::*field;
+};
+
+const BoolOption boolOptions[] = {
+    {"verify-each", &JitOptions::verifyEach},
+    {"disable-d-passes", &JitOptions::disableLangSpecificPasses},
+    {"disable-simplify-drtcalls", &JitOptions::disableSimplifyDruntimeCalls},
+    {"disable-simplify-libcalls", &JitOptions::disableSimplifyLibCalls},
+    {"disable-gc2stack", &JitOptions::disableGCToStack},
+    {"strip-debug", &JitOptions::stripDebug},
+    {"disable-loop-vectorization", &JitOptions::disableLoopVectorization},
+    {"disable-slp-vectorization", &JitOptions::disableSLPVectorization},
+};
+
+bool parseBool(llvm::StringRef value, bool &result) {
+  if (value.empty() || value == "true" || value == "TRUE" ||
+      value == "True" || value == "1") {
+    result = true;
+    return true;
+  }
+  if (value == "false" || value == "FALSE" || value == "False" ||
+      value == "0") {
+    result = false;
+    return true;
+  }
+  return false;
+}
+
+enum class ParseResult { Parsed, Invalid, Unknown };
+
+ParseResult parseJitOption(llvm::StringRef arg, JitOptions &options,
+                           llvm::raw_ostream &errs) {
+  if (!arg.consume_front("-")) {
+    return ParseResult::Unknown;
+  }
+  arg.consume_front("-");
+  auto nameAndValue = arg.split('=');
+  auto name = nameAndValue.first;
+  auto value = nameAndValue.second;
+
+  auto invalidValue = [&]() {
+    errs << "jit: invalid value for -" << name << ": '" << value << "'\n";
+    return ParseResult::Invalid;
+  };
+
+  for (auto &&opt : boolOptions) {
+    if (name == opt.name) {
+      return parseBool(value, options.*opt.field) ? ParseResult::Parsed
+                                                  : invalidValue();
+    }
+  }
+  if (name == "disable-loop-unrolling") {
+    bool disable = false;
+    if (!parseBool(value, disable)) {
+      return invalidValue();
+    }
+    options.disableLoopUnrolling = disable ? 1 : 0;
+    return ParseResult::Parsed;
+  }
+  if (name == "fp-contract") {
+    if (value == "fast") {
+      options.fpContract = llvm::FPOpFusion::Fast;
+    } else if (value == "on") {
+      options.fpContract = llvm::FPOpFusion::Standard;
+    } else if (value == "off") {
+      options.fpContract = llvm::FPOpFusion::Strict;
+    } else {
+      return invalidValue();
+    }
+    return ParseResult::Parsed;
+  }
+  return ParseResult::Unknown;
+}
+
+bool parseLLVMOptions(llvm::ArrayRef<std::string> args, llvm::raw_ostream &os) {
   llvm::SmallVector<const char *, 32> tempOpts;
-  tempOpts.reserve(args.len + 1);
+  tempOpts.reserve(args.size() + 1);
   tempOpts.push_back("jit"); // dummy app name
-  for (size_t i = 0; i < args.len; ++i) {
-    auto &arg = args.data[i];
-    tempStrs.push_back(std::string(arg.data, arg.len));
-    tempOpts.push_back(tempStrs.back().c_str());
+  for (auto &&arg : args) {
+    tempOpts.push_back(arg.c_str());
+  }
+
+  // Options of previous calls must not stay active
+  llvm::cl::ResetAllOptionOccurrences();
+  for (auto &i : llvm::cl::getRegisteredOptions()) {
+    i.second->setDefault();
   }
+  return llvm::cl::ParseCommandLineOptions(static_cast<int>(tempOpts.size()),
+                                           tempOpts.data(), "", &os);
+}
+} // anon namespace
 
+bool parseOptions(Slice<Slice<const char>> args,
+                  void (*errs)(void *, const char *, size_t),
+                  void *errsContext, JitOptions &options,
+                  bool allowLLVMOptions) {
   auto callback = [&](const char *str, size_t len) {
     if (errs != nullptr) {
       errs(errsContext, str, len);
@@ -35,13 +138,63 @@ bool parseOptions(Slice<Slice<const char>> args,
   };
   CallbackOstream os(callback);
 
-  // There is no Option::setDefault() before llvm 60
-  llvm::cl::ResetAllOptionOccurrences();
-  for (auto &i : llvm::cl::getRegisteredOptions()) {
-    i.second->setDefault();
+  bool res = true;
+  JitOptions parsed;
+  llvm::SmallVector<std::string, 8> llvmArgs;
+  for (size_t i = 0; i < args.len; ++i) {
+    auto &arg = args.data[i];
+    llvm::StringRef str(arg.data, arg.len);
+    parsed.args += str;
+    parsed.args += '\0';
+    switch (parseJitOption(str, parsed, os)) {
+    case ParseResult::Parsed:
+      break;
+    case ParseResult::Invalid:
+      res = false;
+      break;
+    case ParseResult::Unknown:
+      if (allowLLVMOptions) {
+        llvmArgs.push_back(str.str());
+      } else {
+        os << "jit: unknown option: '" << str << "'\n";
+        res = false;
+      }
+      break;
+    }
+  }
+
+  if (allowLLVMOptions) {
+    std::lock_guard<std::mutex> lock(optionsMutex());
+    if (!parseLLVMOptions(llvmArgs, os)) {
+      res = false;
+    }
+    // Even a failed parse may have applied some of the options.
+    auto &llvmOptionsString = llvmOptions();
+    llvmOptionsString.clear();
+    for (auto &&str : llvmArgs) {
+      llvmOptionsString += str;
+      llvmOptionsString += '\0';
+    }
   }
-  auto res = llvm::cl::ParseCommandLineOptions(
-      static_cast<int>(tempOpts.size()), tempOpts.data(), "", &os);
   os.flush();
+
+  if (res) {
+    options = std::move(parsed);
+  }
   return res;
 }
+
+JitOptions getGlobalOptions() {
+  std::lock_guard<std::mutex> lock(optionsMutex());
+  return globalOptions();
+}
+
+void setGlobalOptions(JitOptions options) {
+  std::lock_guard<std::mutex> lock(optionsMutex());
+  globalOptions() = std::move(options);
+}
+
+std::string getLLVMOptionsString() {
+  std::lock_guard<std::mutex> lock(optionsMutex());
+  return llvmOptions();
+}
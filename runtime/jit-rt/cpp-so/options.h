@@ -16,8 +16,43 @@
 
 #include "slice.h"
 
+#include <string>
+
+#include "llvm/Target/TargetOptions.h"
+
+/// Options set through setDynamicCompilerOptions, applied per compilation
+/// instead of through global llvm::cl options.
+struct JitOptions final {
+  bool verifyEach = false;
+  bool disableLangSpecificPasses = false;
+  bool disableSimplifyDruntimeCalls = false;
+  bool disableSimplifyLibCalls = false;
+  bool disableGCToStack = false;
+  bool stripDebug = false;
+  /// -1 if not set, loop unrolling depends on the optimization level then.
+  int disableLoopUnrolling = -1;
+  bool disableLoopVectorization = false;
+  bool disableSLPVectorization = false;
+
+  llvm::FPOpFusion::FPOpFusionMode fpContract = llvm::FPOpFusion::Standard;
+
+  /// The arguments these options were parsed from, usable as a cache key.
+  std::string args;
+};
+
+/// Parses the options into `options`. Arguments which aren't jit options are
+/// passed to LLVM if `allowLLVMOptions` is set, those are process-wide.
 bool parseOptions(Slice<Slice<const char>> args,
                   void (*errs)(void *, const char *, size_t),
-                  void *errsContext);
+                  void *errsContext, JitOptions &options,
+                  bool allowLLVMOptions);
+
+/// Options used by contexts without their own options.
+JitOptions getGlobalOptions();
+void setGlobalOptions(JitOptions options);
+
+/// LLVM options set by the last parseOptions() call, in a form usable as a
+/// cache key.
+std::string getLLVMOptionsString();
 
 #endif // OPTIONS_HPP
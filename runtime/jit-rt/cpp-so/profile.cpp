@@ -0,0 +1,180 @@
+//===-- profile.cpp -------------------------------------------------------===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the Boost Software License. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "profile.h"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <vector>
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/ProfileSummary.h"
+#include "llvm/ProfileData/InstrProf.h"
+#include "llvm/ProfileData/ProfileCommon.h"
+
+const char *const ProfileCountersName = "ldc.jit.profile_counters";
+
+namespace {
+// Larger switches aren't profiled, counting their cases would be too slow.
+const unsigned MaxSwitchSuccessors = 32;
+
+// Assigns the counters, the order must not depend on anything but the IR.
+// Each function gets its entry count, followed by a count for each successor
+// of its conditional branches and switches. Switch defaults come last.
+template <typename F, typename T>
+size_t enumCounters(llvm::Module &module, F &&onFunction, T &&onTerminator) {
+  size_t index = 0;
+  for (auto &&func : module.functions()) {
+    if (func.isDeclaration()) {
+      continue;
+    }
+    onFunction(func, index);
+    ++index;
+    for (auto &&bb : func) {
+      auto term = bb.getTerminator();
+      if (auto br = llvm::dyn_cast<llvm::BranchInst>(term)) {
+        if (br->isConditional()) {
+          onTerminator(*br, index);
+          index += 2;
+        }
+      } else if (auto sw = llvm::dyn_cast<llvm::SwitchInst>(term)) {
+        if (sw->getNumSuccessors() <= MaxSwitchSuccessors) {
+          onTerminator(*sw, index);
+          index += sw->getNumCases() + 1;
+        }
+      }
+    }
+  }
+  return index;
+}
+
+// Counters are updated without synchronization like clang's instrumentation
+// does by default, a few lost updates don't matter.
+void increment(llvm::IRBuilder<> &builder, llvm::Type *countersType,
+               llvm::Value *counters, llvm::Value *index) {
+  auto ptr = builder.CreateInBoundsGEP(countersType, counters,
+                                       {builder.getInt64(0), index});
+  auto value = builder.CreateLoad(builder.getInt64Ty(), ptr);
+  builder.CreateStore(builder.CreateAdd(value, builder.getInt64(1)), ptr);
+}
+} // anon namespace
+
+size_t addProfileCounters(llvm::Module &module) {
+  const auto count = enumCounters(
+      module, [](llvm::Function &, size_t) {},
+      [](llvm::Instruction &, size_t) {});
+  if (0 == count) {
+    return 0;
+  }
+
+  auto &context = module.getContext();
+  auto countersType =
+      llvm::ArrayType::get(llvm::Type::getInt64Ty(context), count);
+  auto counters = module.getOrInsertGlobal(ProfileCountersName, countersType);
+
+  enumCounters(
+      module,
+      [&](llvm::Function &func, size_t index) {
+        // Keep static allocas in the entry block
+        auto &entry = func.getEntryBlock();
+        auto it = entry.getFirstInsertionPt();
+        while (llvm::isa<llvm::AllocaInst>(*it)) {
+          ++it;
+        }
+        llvm::IRBuilder<> builder(&entry, it);
+        increment(builder, countersType, counters, builder.getInt64(index));
+      },
+      [&](llvm::Instruction &term, size_t index) {
+        llvm::IRBuilder<> builder(&term);
+        llvm::Value *counter = nullptr;
+        if (auto br = llvm::dyn_cast<llvm::BranchInst>(&term)) {
+          counter = builder.CreateSelect(br->getCondition(),
+                                         builder.getInt64(index),
+                                         builder.getInt64(index + 1));
+        } else {
+          auto sw = llvm::cast<llvm::SwitchInst>(&term);
+          counter = builder.getInt64(index + sw->getNumCases());
+          for (auto &&c : sw->cases()) {
+            counter = builder.CreateSelect(
+                builder.CreateICmpEQ(sw->getCondition(), c.getCaseValue()),
+                builder.getInt64(index + c.getCaseIndex()), counter);
+          }
+        }
+        increment(builder, countersType, counters, counter);
+      });
+  return count;
+}
+
+void applyProfile(llvm::Module &module, llvm::ArrayRef<uint64_t> counters) {
+  auto &context = module.getContext();
+  llvm::MDBuilder mdBuilder(context);
+  llvm::InstrProfSummaryBuilder summary(
+      llvm::ProfileSummaryBuilder::DefaultCutoffs);
+  // The summary takes the counts of a function at once, entry count first.
+  std::vector<uint64_t> functionCounts;
+  auto addToSummary = [&]() {
+    if (!functionCounts.empty()) {
+      summary.addRecord(llvm::InstrProfRecord(std::move(functionCounts)));
+      functionCounts.clear();
+    }
+  };
+
+  const auto count = enumCounters(
+      module,
+      [&](llvm::Function &func, size_t index) {
+        assert(index < counters.size());
+        addToSummary();
+        func.setEntryCount(llvm::Function::ProfileCount(
+            counters[index], llvm::Function::PCT_Real));
+        functionCounts.push_back(counters[index]);
+      },
+      [&](llvm::Instruction &term, size_t index) {
+        // Branch weights list the successors in order, switch weights start
+        // with the default.
+        llvm::SmallVector<uint64_t, 8> counts;
+        if (llvm::isa<llvm::BranchInst>(term)) {
+          counts = {counters[index], counters[index + 1]};
+        } else {
+          auto sw = llvm::cast<llvm::SwitchInst>(&term);
+          counts.push_back(counters[index + sw->getNumCases()]);
+          for (unsigned i = 0; i < sw->getNumCases(); ++i) {
+            counts.push_back(counters[index + i]);
+          }
+        }
+        functionCounts.insert(functionCounts.end(), counts.begin(),
+                              counts.end());
+
+        const auto max = *std::max_element(counts.begin(), counts.end());
+        if (0 == max) {
+          // Never executed, leave it to the static heuristics.
+          return;
+        }
+        // Weights are 32 bit
+        const uint64_t scale =
+            max / std::numeric_limits<uint32_t>::max() + 1;
+        llvm::SmallVector<uint32_t, 8> weights;
+        for (auto c : counts) {
+          weights.push_back(static_cast<uint32_t>(c / scale));
+        }
+        term.setMetadata(llvm::LLVMContext::MD_prof,
+                         mdBuilder.createBranchWeights(weights));
+      });
+  (void)count;
+  assert(count == counters.size() && "Module doesn't match the profile");
+  addToSummary();
+
+  module.setProfileSummary(summary.getSummary()->getMD(context),
+                           llvm::ProfileSummary::PSK_Instr);
+}
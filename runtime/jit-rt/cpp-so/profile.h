@@ -0,0 +1,39 @@
+//===-- profile.h - jit support ---------------------------------*- C++ -*-===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the Boost Software License. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Jit runtime - profile guided optimization.
+// Functions count their calls and the outcomes of their branches, the counts
+// are attached to an uninstrumented copy of the module as profile metadata
+// before it is optimized again.
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "llvm/ADT/ArrayRef.h"
+
+namespace llvm {
+class Module;
+}
+
+/// Array of 64 bit counters referenced by the instrumented code, must be
+/// provided by the jit.
+extern const char *const ProfileCountersName;
+
+/// Instruments all functions defined in the module, returns the number of
+/// counters used.
+size_t addProfileCounters(llvm::Module &module);
+
+/// Sets function entry counts, branch weights and the profile summary.
+/// The module must be an uninstrumented copy of the one passed to
+/// addProfileCounters.
+void applyProfile(llvm::Module &module, llvm::ArrayRef<uint64_t> counters);
@@ -0,0 +1,141 @@
+//===-- tiering.cpp -------------------------------------------------------===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the Boost Software License. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "tiering.h"
+
+#include <cassert>
+#include <utility>
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+
+const char *const TierUpHandlerName = "ldc.jit.tier_up";
+const char *const TierUpDataName = "ldc.jit.tier_up_data";
+
+namespace {
+const char *const BaselineFlagName = "ldc.jit.baseline";
+}
+
+void addTierUpCounters(llvm::Module &module,
+                       llvm::ArrayRef<std::string> functions,
+                       unsigned threshold) {
+  assert(threshold > 0);
+  auto &context = module.getContext();
+  auto int32Type = llvm::Type::getInt32Ty(context);
+  auto ptrType = llvm::PointerType::getUnqual(context);
+  auto countersType = llvm::ArrayType::get(int32Type, functions.size());
+  auto counters = new llvm::GlobalVariable(
+      module, countersType, false, llvm::GlobalValue::PrivateLinkage,
+      llvm::ConstantAggregateZero::get(countersType), ".jit_tier_counters");
+  auto handler = module.getOrInsertFunction(
+      TierUpHandlerName,
+      llvm::FunctionType::get(llvm::Type::getVoidTy(context),
+                              {ptrType, int32Type}, false));
+  auto data = module.getOrInsertGlobal(TierUpDataName,
+                                       llvm::Type::getInt8Ty(context));
+  auto weights = llvm::MDBuilder(context).createBranchWeights(1, 1 << 20);
+
+  for (size_t i = 0; i < functions.size(); ++i) {
+    auto func = module.getFunction(functions[i]);
+    if (nullptr == func || func->isDeclaration()) {
+      continue;
+    }
+    // Keep static allocas in the entry block
+    auto &entry = func->getEntryBlock();
+    auto it = entry.getFirstInsertionPt();
+    while (llvm::isa<llvm::AllocaInst>(*it)) {
+      ++it;
+    }
+    llvm::IRBuilder<> builder(&entry, it);
+    auto counter = builder.CreateConstInBoundsGEP2_32(countersType, counters,
+                                                      0, i);
+    // Exact comparison, so the handler is called only once
+    auto old = builder.CreateAtomicRMW(
+        llvm::AtomicRMWInst::Add, counter, builder.getInt32(1),
+        llvm::MaybeAlign(4), llvm::AtomicOrdering::Monotonic);
+    auto hot = builder.CreateICmpEQ(old, builder.getInt32(threshold - 1));
+    auto then = llvm::SplitBlockAndInsertIfThen(hot, &*builder.GetInsertPoint(),
+                                                false, weights);
+    builder.SetInsertPoint(then);
+    builder.CreateCall(handler, {data, builder.getInt32(i)});
+  }
+}
+
+void setBaselineTier(llvm::Module &module) {
+  module.addModuleFlag(llvm::Module::Warning, BaselineFlagName, 1);
+}
+
+bool isBaselineTier(const llvm::Module &module) {
+  return nullptr != module.getModuleFlag(BaselineFlagName);
+}
+
+TierUpWorker::TierUpWorker(Handler h)
+    : handler(std::move(h)), thread([this]() { run(); }) {}
+
+TierUpWorker::~TierUpWorker() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopped = true;
+  }
+  condition.notify_one();
+  thread.join();
+}
+
+void TierUpWorker::request(uint32_t index) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    pending.push_back(index);
+  }
+  condition.notify_one();
+}
+
+void TierUpWorker::requestAfter(std::chrono::milliseconds delay,
+                                std::vector<uint32_t> indices) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    delayed = std::move(indices);
+    deadline = std::chrono::steady_clock::now() + delay;
+  }
+  condition.notify_one();
+}
+
+void TierUpWorker::run() {
+  std::vector<uint32_t> batch;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      auto due = [&]() {
+        return !delayed.empty() &&
+               std::chrono::steady_clock::now() >= deadline;
+      };
+      auto ready = [&]() { return stopped || !pending.empty() || due(); };
+      if (delayed.empty()) {
+        condition.wait(lock, ready);
+      } else {
+        condition.wait_until(lock, deadline, ready);
+      }
+      if (stopped) {
+        return;
+      }
+      if (due()) {
+        pending.insert(pending.end(), delayed.begin(), delayed.end());
+        delayed.clear();
+      }
+      if (pending.empty()) {
+        continue;
+      }
+      batch.swap(pending);
+    }
+    handler(batch);
+    batch.clear();
+  }
+}
@@ -0,0 +1,83 @@
+//===-- tiering.h - jit support ---------------------------------*- C++ -*-===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the Boost Software License. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Jit runtime - tiered compilation.
+// Baseline code counts calls of its entry functions and requests an optimized
+// recompilation once a function gets hot.
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+
+namespace llvm {
+class Module;
+}
+
+/// Symbols referenced by the call counters, must be provided by the jit.
+/// The handler is called as `handler(&data, index)`.
+extern const char *const TierUpHandlerName;
+extern const char *const TierUpDataName;
+
+using TierUpHandlerT = void (*)(void *, uint32_t);
+
+/// Adds a call counter to each function. Once functions[i] has been called
+/// `threshold` times it calls the tier up handler with index i.
+void addTierUpCounters(llvm::Module &module,
+                       llvm::ArrayRef<std::string> functions,
+                       unsigned threshold);
+
+/// Marks the module to be compiled as the baseline tier.
+void setBaselineTier(llvm::Module &module);
+
+/// Whether the module is compiled as the baseline tier, i.e. with minimal
+/// codegen optimizations.
+bool isBaselineTier(const llvm::Module &module);
+
+/// Processes tier up requests on a background thread, requests arriving while
+/// a batch is compiled are handled together in the next one.
+class TierUpWorker final {
+public:
+  using Handler = std::function<void(llvm::ArrayRef<uint32_t>)>;
+
+  explicit TierUpWorker(Handler handler);
+  /// Waits for the current batch, pending requests are dropped.
+  ~TierUpWorker();
+
+  /// Thread-safe, may be called from jitted code.
+  void request(uint32_t index);
+
+  /// Requests the functions once the delay has passed, replaces a previous
+  /// delayed request.
+  void requestAfter(std::chrono::milliseconds delay,
+                    std::vector<uint32_t> indices);
+
+private:
+  void run();
+
+  Handler handler;
+  std::mutex mutex;
+  std::condition_variable condition;
+  std::vector<uint32_t> pending;
+  std::vector<uint32_t> delayed;
+  std::chrono::steady_clock::time_point deadline;
+  bool stopped = false;
+  std::thread thread;
+};
@@ -9,6 +9,7 @@
 
 #include "utils.h"
 
+#include <atomic>
 #include <cassert>
 #include <cstdio>
 #include <cstdlib>
@@ -46,3 +47,11 @@ void verifyModule(const Context &context, llvm::Module &module) {
     fatal(context, desc);
   }
 }
+
+void storeFunctionPointer(void **ptr, void *value) {
+  assert(nullptr != ptr);
+  static_assert(sizeof(std::atomic<void *>) == sizeof(void *),
+                "std::atomic<void *> must have the layout of void *");
+  reinterpret_cast<std::atomic<void *> *>(ptr)->store(
+      value, std::memory_order_release);
+}
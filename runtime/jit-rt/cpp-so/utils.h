@@ -24,3 +24,7 @@ void fatal(const Context &context, const std::string &reason);
 void interruptPoint(const Context &context, const char *desc,
                     const char *object = "");
 void verifyModule(const Context &context, llvm::Module &module);
+
+/// Publishes a function address which may be read concurrently by callers on
+/// other threads.
+void storeFunctionPointer(void **ptr, void *value);
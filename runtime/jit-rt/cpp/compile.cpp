@@ -16,6 +16,7 @@
 
 struct Context;
 struct ParamSlice;
+struct Stats;
 
 #ifdef _WIN32
 #define EXTERNAL __declspec(dllimport) extern
@@ -42,6 +43,8 @@ template <typename T> struct Slice final {
 #define JIT_DESTROY_COMPILER_CONTEXT                                           \
   MAKE_JIT_API_CALL(destroyDynamicCompilerContextSo)
 #define JIT_SET_OPTS MAKE_JIT_API_CALL(setDynamicCompilerOptsImpl)
+#define JIT_WAIT_FOR_CODE MAKE_JIT_API_CALL(waitForDynamicCodeSo)
+#define JIT_GET_STATS MAKE_JIT_API_CALL(getDynamicCompileStatsSo)
 
 struct DynamicCompilerContext;
 
@@ -58,7 +61,8 @@ EXTERNAL void JIT_API_ENTRYPOINT(const void *modlist_head,
 
 EXTERNAL void JIT_REG_BIND_PAYLOAD(DynamicCompilerContext *context,
                                    void *handle, void *originalFunc,
-                                   const ParamSlice *desc, size_t descSize);
+                                   void *exampleFunc, const ParamSlice *desc,
+                                   size_t descSize);
 
 EXTERNAL void JIT_UNREG_BIND_PAYLOAD(DynamicCompilerContext *context,
                                      void *handle);
@@ -67,7 +71,13 @@ EXTERNAL DynamicCompilerContext *JIT_CREATE_COMPILER_CONTEXT();
 
 EXTERNAL void JIT_DESTROY_COMPILER_CONTEXT(DynamicCompilerContext *context);
 
-EXTERNAL bool JIT_SET_OPTS(const Slice<Slice<const char>> *args,
+EXTERNAL void JIT_WAIT_FOR_CODE(DynamicCompilerContext *context);
+
+EXTERNAL void JIT_GET_STATS(DynamicCompilerContext *context, Stats *stats,
+                            std::size_t statsSize);
+
+EXTERNAL bool JIT_SET_OPTS(DynamicCompilerContext *context,
+                           const Slice<Slice<const char>> *args,
                            void (*errs)(void *, const char *, size_t),
                            void *errsContext);
 
@@ -76,9 +86,10 @@ void rtCompileProcessImpl(const Context *context, std::size_t contextSize) {
 }
 
 void registerBindPayload(DynamicCompilerContext *context, void *handle,
-                         void *originalFunc, const ParamSlice *desc,
-                         size_t descSize) {
-  JIT_REG_BIND_PAYLOAD(context, handle, originalFunc, desc, descSize);
+                         void *originalFunc, void *exampleFunc,
+                         const ParamSlice *desc, size_t descSize) {
+  JIT_REG_BIND_PAYLOAD(context, handle, originalFunc, exampleFunc, desc,
+                       descSize);
 }
 
 void unregisterBindPayload(DynamicCompilerContext *context, void *handle) {
@@ -92,9 +103,19 @@ void destroyDynamicCompilerContextImpl(DynamicCompilerContext *context) {
   JIT_DESTROY_COMPILER_CONTEXT(context);
 }
 
-bool setDynamicCompilerOpts(const Slice<Slice<const char>> *args,
+void waitForDynamicCodeImpl(DynamicCompilerContext *context) {
+  JIT_WAIT_FOR_CODE(context);
+}
+
+void getDynamicCompileStatsImpl(DynamicCompilerContext *context, Stats *stats,
+                                std::size_t statsSize) {
+  JIT_GET_STATS(context, stats, statsSize);
+}
+
+bool setDynamicCompilerOpts(DynamicCompilerContext *context,
+                            const Slice<Slice<const char>> *args,
                             void (*errs)(void *, const char *, size_t),
                             void *errsContext) {
-  return JIT_SET_OPTS(args, errs, errsContext);
+  return JIT_SET_OPTS(context, args, errs, errsContext);
 }
 }
@@ -38,6 +38,7 @@
 #include "llvm/Support/WithColor.h"
 #include "llvm/Support/raw_ostream.h"
 #include <algorithm>
+#include <atomic>
 #include <queue>
 
 using namespace llvm;
@@ -370,13 +371,45 @@ static void writeInstrProfile(StringRef OutputFilename,
   }
 }
 
+/// Merge the writer contexts pairwise in parallel (~ lg(NumThreads) serial
+/// steps), freeing each context as soon as it has been merged into another.
+/// (LDC-specific)
+static void reduceWriterContexts(
+    ThreadPool &Pool,
+    SmallVectorImpl<std::unique_ptr<WriterContext>> &Contexts) {
+  while (Contexts.size() > 1) {
+    const size_t Half = (Contexts.size() + 1) / 2;
+    for (size_t I = 0; I + Half < Contexts.size(); ++I)
+      Pool.async(mergeWriterContexts, Contexts[I].get(),
+                 Contexts[I + Half].get());
+    Pool.wait();
+    Contexts.resize(Half);
+  }
+}
+
+/// Drop the functions whose counts are all below \p MinCount from the
+/// profile. (LDC-specific)
+static void dropColdFunctions(InstrProfWriter &Writer, uint64_t MinCount) {
+  auto &ProfileMap = Writer.getProfileData();
+  for (auto I = ProfileMap.begin(); I != ProfileMap.end();) {
+    auto Tmp = I++;
+    uint64_t MaxCount = 0;
+    for (const auto &HashAndRecord : Tmp->getValue())
+      for (uint64_t Count : HashAndRecord.second.Counts)
+        MaxCount = std::max(MaxCount, Count);
+    if (MaxCount < MinCount)
+      ProfileMap.erase(Tmp);
+  }
+}
+
 static void mergeInstrProfile(const WeightedFileVector &Inputs,
                               StringRef DebugInfoFilename,
                               SymbolRemapper *Remapper,
                               StringRef OutputFilename,
                               ProfileFormat OutputFormat, bool OutputSparse,
                               unsigned NumThreads, FailureMode FailMode,
-                              const StringRef ProfiledBinary) {
+                              const StringRef ProfiledBinary,
+                              bool StreamingMerge, uint64_t MinFunctionCount) {
   if (OutputFormat != PF_Binary && OutputFormat != PF_Compact_Binary &&
       OutputFormat != PF_Ext_Binary && OutputFormat != PF_Text)
     exitWithError("unknown format is specified");
@@ -411,6 +444,21 @@ static void mergeInstrProfile(const WeightedFileVector &Inputs,
     for (const auto &Input : Inputs)
       loadInput(Input, Remapper, Correlator.get(), ProfiledBinary,
                 Contexts[0].get());
+  } else if (StreamingMerge) {
+    ThreadPool Pool(hardware_concurrency(NumThreads));
+
+    // Each thread loads the next input into its own context as soon as it is
+    // done with the previous one: there's one input per thread in memory, and
+    // no thread waits for the context of another one.
+    std::atomic<size_t> NextInput(0);
+    for (unsigned I = 0; I < NumThreads; ++I)
+      Pool.async([&, WC = Contexts[I].get()] {
+        for (size_t J; (J = NextInput++) < Inputs.size();)
+          loadInput(Inputs[J], Remapper, Correlator.get(), ProfiledBinary, WC);
+      });
+    Pool.wait();
+
+    reduceWriterContexts(Pool, Contexts);
   } else {
     ThreadPool Pool(hardware_concurrency(NumThreads));
 
@@ -455,6 +503,9 @@ static void mergeInstrProfile(const WeightedFileVector &Inputs,
       (NumErrors > 0 && FailMode == failIfAnyAreInvalid))
     exitWithError("no profile can be merged");
 
+  if (MinFunctionCount > 0)
+    dropColdFunctions(Contexts[0]->Writer, MinFunctionCount);
+
   writeInstrProfile(OutputFilename, OutputFormat, Contexts[0]->Writer);
 }
 
@@ -958,6 +1009,17 @@ static int merge_main(int argc, const char *argv[]) {
       cl::desc("Number of merge threads to use (default: autodetect)"));
   cl::alias NumThreadsA("j", cl::desc("Alias for --num-threads"),
                         cl::aliasopt(NumThreads));
+  // LDC-specific
+  cl::opt<bool> StreamingMerge(
+      "streaming", cl::init(false),
+      cl::desc("Merge the inputs in a streaming fashion: each thread merges "
+               "the next input as soon as it is done with the previous one, "
+               "and the per-thread profiles are freed as soon as they are "
+               "reduced"));
+  cl::opt<uint64_t> MinFunctionCount(
+      "min-function-count", cl::init(0),
+      cl::desc("Drop the functions whose counts are all below this threshold "
+               "from the merged profile (only meaningful for -instr)"));
   cl::opt<std::string> ProfileSymbolListFile(
       "prof-sym-list", cl::init(""),
       cl::desc("Path to file containing the list of function symbols "
@@ -1058,7 +1120,8 @@ static int merge_main(int argc, const char *argv[]) {
   if (ProfileKind == instr)
     mergeInstrProfile(WeightedInputs, DebugInfoFilename, Remapper.get(),
                       OutputFilename, OutputFormat, OutputSparse, NumThreads,
-                      FailureMode, ProfiledBinary);
+                      FailureMode, ProfiledBinary, StreamingMerge,
+                      MinFunctionCount);
   else
     mergeSampleProfile(WeightedInputs, Remapper.get(), OutputFilename,
                        OutputFormat, ProfileSymbolListFile, CompressAllSections,